@@ -0,0 +1,31 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <iomanip>
+#include <iostream>
+#include <string>
+
+// Minimal timing harness shared by the benchmarks in this directory
+// Each benchmark is its own executable, built with -DBUILD_BENCHMARKS=ON and run by hand; numbers go to stdout
+
+// Keeps the compiler from discarding a result that is otherwise unused
+template <typename T>
+inline void KeepAlive(const T& value) {
+	asm volatile("" : : "g"(&value) : "memory");
+}
+
+// Runs function once to warm up, then iterations times, and prints and returns the mean time per call in nanoseconds
+template <typename Function>
+double Measure(const std::string& name, size_t iterations, Function function) {
+	function();
+
+	auto start = std::chrono::steady_clock::now();
+	for (size_t i = 0; i < iterations; ++i) {
+		function();
+	}
+	double nanos = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / iterations;
+
+	std::cout << std::left << std::setw(48) << name << std::right << std::fixed << std::setprecision(2) << std::setw(12) << nanos / 1000 << " us/op" << std::setw(14) << std::setprecision(0) << 1e9 / nanos << " op/s\n";
+	return nanos;
+}
@@ -0,0 +1,49 @@
+#include "bench.hpp"
+#include "postgres.hpp"
+#include "../include/statements.hpp"
+
+// Cost of attaching 1, 10 and 50 files to an assignment: one INSERT round trip per file, as the handlers used to,
+// against the single InsertAssignmentFiles statement; each run is rolled back so the table does not grow
+
+int main() {
+	PostgresConnection connection = ConnectForBenchmark();
+	if (connection == nullptr) {
+		return 1;
+	}
+
+	PGconn* sql = connection.get();
+	Statements::PrepareAll(sql);
+
+	QueryResult assignment(PQexec(sql, "SELECT id::text FROM assignments LIMIT 1"));
+	if (assignment.Rows() == 0) {
+		std::cerr << "Needs at least one assignment to attach files to\n";
+		return 1;
+	}
+
+	std::string assignmentId(assignment.Get(0, 0));
+	QueryResult(PQprepare(sql, "insert_assignment_file", "INSERT INTO assignment_files (assignment_id, link) VALUES ($1, $2)", 2, nullptr));
+
+	for (size_t count : { 1, 10, 50 }) {
+		std::vector<std::string> links;
+		for (size_t i = 0; i < count; ++i) {
+			links.push_back("https://example.blob.core.windows.net/assignments/bench-" + std::to_string(i));
+		}
+
+		Measure(std::to_string(count) + " files, one INSERT per file", 200, [&]() {
+			QueryResult(PQexec(sql, "BEGIN"));
+			for (const std::string& link : links) {
+				const char* values[] = { assignmentId.c_str(), link.c_str() };
+				QueryResult(PQexecPrepared(sql, "insert_assignment_file", 2, values, nullptr, nullptr, 0));
+			}
+			QueryResult(PQexec(sql, "ROLLBACK"));
+		});
+
+		std::string array = ToParameter(links);
+		Measure(std::to_string(count) + " files, one InsertAssignmentFiles", 200, [&]() {
+			QueryResult(PQexec(sql, "BEGIN"));
+			const char* values[] = { assignmentId.c_str(), array.c_str() };
+			QueryResult(PQexecPrepared(sql, Statements::InsertAssignmentFiles.name, 2, values, nullptr, nullptr, 0));
+			QueryResult(PQexec(sql, "ROLLBACK"));
+		});
+	}
+}
@@ -0,0 +1,125 @@
+#include "bench.hpp"
+#include "../include/groupIndex.hpp"
+#include <algorithm>
+#include <random>
+
+// Joining the rowsets of a 500 student x 100 assignment classroom: a find_if over a rowset for every row of the other,
+// as the listing handlers used to, against GroupIndex
+// GetAllAssignments joins each assignment to one student's submissions and grades, GetAllSubmissions each student
+// of one assignment to their submission, its files and their grade
+
+namespace {
+	constexpr int students = 500;
+	constexpr int assignments = 100;
+
+	struct SubmissionRow {
+		int id;
+		int assignmentId;
+		int userId;
+	};
+
+	struct FileRow {
+		int id;
+		int submissionId;
+	};
+
+	struct GradeRow {
+		int id;
+		int assignmentId;
+		int userId;
+	};
+
+	// rows come back in id order, which is the order they were written in, not grouped by any key
+	template <typename Row>
+	void Shuffle(std::vector<Row>& rows, std::mt19937& random) {
+		std::shuffle(rows.begin(), rows.end(), random);
+		for (size_t i = 0; i < rows.size(); ++i) {
+			rows[i].id = (int)i + 1;
+		}
+	}
+}
+
+int main() {
+	std::mt19937 random(47);
+
+	// one student's rows: most assignments submitted, some twice, fewer graded, and a find_if for a missing one scans everything
+	std::vector<SubmissionRow> submissions;
+	std::vector<GradeRow> grades;
+	for (int assignment = 1; assignment <= assignments; ++assignment) {
+		if (assignment % 5 != 0) {
+			submissions.push_back({ 0, assignment, 1 });
+		}
+		if (assignment % 4 == 0) {
+			submissions.push_back({ 0, assignment, 1 });
+		}
+		if (assignment % 3 != 0) {
+			grades.push_back({ 0, assignment, 1 });
+		}
+	}
+	Shuffle(submissions, random);
+	Shuffle(grades, random);
+
+	// one assignment's submissions, two files each
+	std::vector<SubmissionRow> assignmentSubmissions;
+	std::vector<GradeRow> assignmentGrades;
+	std::vector<FileRow> files;
+	for (int student = 1; student <= students; ++student) {
+		assignmentSubmissions.push_back({ 0, 1, student });
+		assignmentGrades.push_back({ 0, 1, student });
+	}
+	Shuffle(assignmentSubmissions, random);
+	Shuffle(assignmentGrades, random);
+	for (const SubmissionRow& submission : assignmentSubmissions) {
+		files.push_back({ 0, submission.id });
+		files.push_back({ 0, submission.id });
+	}
+	Shuffle(files, random);
+
+	Measure("GetAllAssignments join, find_if", 20000, [&]() {
+		for (int assignment = 1; assignment <= assignments; ++assignment) {
+			auto submission = std::find_if(submissions.begin(), submissions.end(), [assignment](const SubmissionRow& row) { return row.assignmentId == assignment; });
+			auto grade = std::find_if(grades.begin(), grades.end(), [assignment](const GradeRow& row) { return row.assignmentId == assignment; });
+			KeepAlive(submission);
+			KeepAlive(grade);
+		}
+	});
+
+	Measure("GetAllAssignments join, GroupIndex", 20000, [&]() {
+		GroupIndex<SubmissionRow> submissionsByAssignment(submissions, [](const SubmissionRow& row) { return row.assignmentId; });
+		GroupIndex<GradeRow> gradesByAssignment(grades, [](const GradeRow& row) { return row.assignmentId; });
+
+		for (int assignment = 1; assignment <= assignments; ++assignment) {
+			const SubmissionRow* submission = submissionsByAssignment.First(assignment);
+			const GradeRow* grade = gradesByAssignment.First(assignment);
+			KeepAlive(submission);
+			KeepAlive(grade);
+		}
+	});
+
+	Measure("GetAllSubmissions join, find_if", 2000, [&]() {
+		for (int student = 1; student <= students; ++student) {
+			auto submission = std::find_if(assignmentSubmissions.begin(), assignmentSubmissions.end(), [student](const SubmissionRow& row) { return row.userId == student; });
+			size_t fileCount = 0;
+			for (const FileRow& file : files) {
+				fileCount += file.submissionId == submission->id;
+			}
+			auto grade = std::find_if(assignmentGrades.begin(), assignmentGrades.end(), [student](const GradeRow& row) { return row.userId == student; });
+			KeepAlive(fileCount);
+			KeepAlive(grade);
+		}
+	});
+
+	Measure("GetAllSubmissions join, GroupIndex", 2000, [&]() {
+		GroupIndex<SubmissionRow> submissionsByUser(assignmentSubmissions, [](const SubmissionRow& row) { return row.userId; });
+		GroupIndex<FileRow> filesBySubmission(files, [](const FileRow& row) { return row.submissionId; });
+		GroupIndex<GradeRow> gradesByUser(assignmentGrades, [](const GradeRow& row) { return row.userId; });
+
+		for (int student = 1; student <= students; ++student) {
+			const SubmissionRow* submission = submissionsByUser.First(student);
+			size_t fileCount = filesBySubmission.All(submission->id).size();
+			const GradeRow* grade = gradesByUser.First(student);
+			KeepAlive(fileCount);
+			KeepAlive(grade);
+		}
+	});
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <openssl/evp.h>
+#include <openssl/pem.h>
+#include <memory>
+#include <stdexcept>
+#include <string>
+
+// A freshly generated key pair in PEM, so the token benchmarks need no key files
+struct KeyPair {
+	std::string publicPem;
+	std::string privatePem;
+};
+
+namespace KeyPairs {
+	inline std::string ToPem(EVP_PKEY* key, bool privateKey) {
+		std::unique_ptr<BIO, decltype(&BIO_free)> bio(BIO_new(BIO_s_mem()), BIO_free);
+
+		int written = privateKey
+			? PEM_write_bio_PrivateKey(bio.get(), key, nullptr, nullptr, 0, nullptr, nullptr)
+			: PEM_write_bio_PUBKEY(bio.get(), key);
+		if (written != 1) {
+			throw std::runtime_error("Failed to write PEM");
+		}
+
+		char* data = nullptr;
+		long length = BIO_get_mem_data(bio.get(), &data);
+		return std::string(data, length);
+	}
+
+	inline KeyPair FromKey(EVP_PKEY* key) {
+		if (key == nullptr) {
+			throw std::runtime_error("Failed to generate key");
+		}
+
+		std::unique_ptr<EVP_PKEY, decltype(&EVP_PKEY_free)> owned(key, EVP_PKEY_free);
+		return { ToPem(key, false), ToPem(key, true) };
+	}
+
+	inline KeyPair Rsa(size_t bits = 2048) {
+		return FromKey(EVP_PKEY_Q_keygen(nullptr, nullptr, "RSA", bits));
+	}
+
+	inline KeyPair P256() {
+		return FromKey(EVP_PKEY_Q_keygen(nullptr, nullptr, "EC", "P-256"));
+	}
+
+	inline KeyPair Ed25519() {
+		return FromKey(EVP_PKEY_Q_keygen(nullptr, nullptr, "ED25519"));
+	}
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <libpq-fe.h>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+
+using PostgresConnection = std::unique_ptr<PGconn, decltype(&PQfinish)>;
+
+// Connection for the database benchmarks: BENCH_DATABASE_URL if set, otherwise libpq's own PGHOST, PGUSER, ... variables
+// Returns nullptr after explaining why if there is no database to run against
+inline PostgresConnection ConnectForBenchmark() {
+	const char* url = std::getenv("BENCH_DATABASE_URL");
+	PostgresConnection connection(PQconnectdb(url == nullptr ? "" : url), PQfinish);
+
+	if (PQstatus(connection.get()) != CONNECTION_OK) {
+		std::cerr << "Needs a database with the service's schema, set BENCH_DATABASE_URL: " << PQerrorMessage(connection.get());
+		return PostgresConnection(nullptr, PQfinish);
+	}
+
+	return connection;
+}
@@ -0,0 +1,38 @@
+#include "bench.hpp"
+#include "postgres.hpp"
+#include "../include/statements.hpp"
+
+// Latency of the membership and assignment lookups sent as one-off statements, parsed and planned on every call
+// as soci sends them, against the same statements prepared once on the connection
+
+namespace {
+	void MeasureStatement(PGconn* connection, const PreparedStatement& statement, const std::vector<std::string>& arguments) {
+		std::vector<const char*> values;
+		for (const std::string& argument : arguments) {
+			values.push_back(argument.c_str());
+		}
+
+		Measure(std::string(statement.name) + " unprepared", 5000, [&]() {
+			QueryResult rows(PQexecParams(connection, statement.sql, statement.parameters, nullptr, values.data(), nullptr, nullptr, 0));
+			KeepAlive(rows);
+		});
+
+		Measure(std::string(statement.name) + " prepared", 5000, [&]() {
+			QueryResult rows(PQexecPrepared(connection, statement.name, statement.parameters, values.data(), nullptr, nullptr, 0));
+			KeepAlive(rows);
+		});
+	}
+}
+
+int main() {
+	PostgresConnection connection = ConnectForBenchmark();
+	if (connection == nullptr) {
+		return 1;
+	}
+
+	Statements::PrepareAll(connection.get());
+
+	// the ids need not exist, a lookup that finds nothing is parsed and planned all the same
+	MeasureStatement(connection.get(), Statements::SelectMembership, { "1", "1" });
+	MeasureStatement(connection.get(), Statements::SelectAssignmentClassroom, { "1" });
+}
@@ -0,0 +1,46 @@
+#include "bench.hpp"
+#include "keys.hpp"
+#include "../include/tokenVerifier.hpp"
+#include <cstdlib>
+
+// Verification throughput of a token from the key ring for each algorithm it accepts
+
+namespace {
+	template <typename Algorithm>
+	void MeasureAlgorithm(TokenVerifier* tokenVerifier, const char* name, const char* keyId, Algorithm algorithm) {
+		std::string token = jwt::create<jwt::traits::nlohmann_json>()
+			.set_issuer("auth0")
+			.set_key_id(keyId)
+			.set_payload_claim("id", jwt::basic_claim<jwt::traits::nlohmann_json>(std::string("42")))
+			.sign(algorithm);
+
+		Measure(name, 2000, [&token, tokenVerifier]() {
+			auto decoded = jwt::decode<jwt::traits::nlohmann_json>(token);
+
+			std::error_code ec;
+			tokenVerifier->VerifierFor(decoded)->verify(decoded, ec);
+			if (ec) {
+				throw std::runtime_error(ec.message());
+			}
+		});
+	}
+}
+
+int main() {
+	KeyPair rsa = KeyPairs::Rsa();
+	KeyPair p256 = KeyPairs::P256();
+	KeyPair ed25519 = KeyPairs::Ed25519();
+
+	nlohmann::json keyRing = nlohmann::json::array({
+		{ { "kid", "rsa" }, { "alg", "RS512" }, { "key", rsa.publicPem } },
+		{ { "kid", "p256" }, { "alg", "ES256" }, { "key", p256.publicPem } },
+		{ { "kid", "ed25519" }, { "alg", "EdDSA" }, { "key", ed25519.publicPem } }
+	});
+
+	setenv("JWT_KEYS", keyRing.dump().c_str(), 1);
+	TokenVerifier* tokenVerifier = TokenVerifier::GetInstance();
+
+	MeasureAlgorithm(tokenVerifier, "RS512 (2048-bit)", "rsa", jwt::algorithm::rs512{ rsa.publicPem, rsa.privatePem, "", "" });
+	MeasureAlgorithm(tokenVerifier, "ES256", "p256", jwt::algorithm::es256{ p256.publicPem, p256.privatePem, "", "" });
+	MeasureAlgorithm(tokenVerifier, "EdDSA (Ed25519)", "ed25519", jwt::algorithm::ed25519{ ed25519.publicPem, ed25519.privatePem, "", "" });
+}
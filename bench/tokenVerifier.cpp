@@ -0,0 +1,63 @@
+#include "bench.hpp"
+#include "keys.hpp"
+#include "../include/tokenVerifier.hpp"
+#include <cstdlib>
+
+// Cost of checking the token of one request:
+// parsing RSASECRET and building a verifier every time, as ValidateToken used to, against the verifier TokenVerifier
+// parses once and shares, and against a repeated token answered from the verified token cache
+
+namespace {
+	// RSASECRET is stored with escaped newlines
+	std::string EscapeNewlines(const std::string& pem) {
+		std::string escaped;
+		for (char c : pem) {
+			escaped += c == '\n' ? std::string("\\n") : std::string(1, c);
+		}
+		return escaped;
+	}
+}
+
+int main() {
+	KeyPair rsa = KeyPairs::Rsa();
+	setenv("RSASECRET", EscapeNewlines(rsa.privatePem).c_str(), 1);
+
+	std::string token = jwt::create<jwt::traits::nlohmann_json>()
+		.set_issuer("auth0")
+		.set_payload_claim("id", jwt::basic_claim<jwt::traits::nlohmann_json>(std::string("42")))
+		.sign(jwt::algorithm::rs512{ rsa.publicPem, rsa.privatePem, "", "" });
+
+	Measure("parse key and build verifier per request", 500, [&token]() {
+		std::string rsaSecret = std::getenv("RSASECRET");
+
+		size_t pos = 0;
+		while ((pos = rsaSecret.find("\\n", pos)) != std::string::npos) {
+			rsaSecret.replace(pos, 2, "\n");
+		}
+
+		auto verifier = jwt::verify<jwt::traits::nlohmann_json>().allow_algorithm(jwt::algorithm::rs512{ "", rsaSecret, "", "" }).with_issuer("auth0");
+		auto decoded = jwt::decode<jwt::traits::nlohmann_json>(token);
+
+		std::error_code ec;
+		verifier.verify(decoded, ec);
+		KeepAlive(ec);
+	});
+
+	TokenVerifier* tokenVerifier = TokenVerifier::GetInstance();
+
+	Measure("shared verifier", 2000, [&token, tokenVerifier]() {
+		auto decoded = jwt::decode<jwt::traits::nlohmann_json>(token);
+
+		std::error_code ec;
+		tokenVerifier->VerifierFor(decoded)->verify(decoded, ec);
+		KeepAlive(ec);
+	});
+
+	TokenDigest digest = TokenVerifier::Digest(token);
+	tokenVerifier->Remember(digest, TokenClaims{ "42", "auth0", std::nullopt, std::nullopt, std::nullopt, nullptr }, tokenVerifier->Generation(), std::chrono::nanoseconds(0));
+
+	Measure("verified token cache hit", 200000, [&token, tokenVerifier]() {
+		std::optional<TokenClaims> claims = tokenVerifier->Lookup(TokenVerifier::Digest(token));
+		KeepAlive(claims);
+	});
+}
@@ -5,8 +5,13 @@
     #include "ctre.hpp"
     #include "debug.hpp"
     #include "event.hpp"
+    #include "route.hpp"
     #include "responsetype.hpp"
+    #include "reactor.hpp"
+    #include "responsewriter.hpp"
     #include "router.hpp"
+    #include "task.hpp"
+    #include "threadpool.hpp"
     #include "tcplistener.hpp"
     #define CPPHTTP
 #endif
\ No newline at end of file
@@ -0,0 +1,114 @@
+#pragma once
+#include <coroutine>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include "threadpool.hpp"
+
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <unistd.h>
+#include <errno.h>
+#endif
+
+namespace CppHttp {
+    namespace Net {
+        // Waits for sockets to become ready on one thread and resumes the coroutines waiting on them,
+        // so a coroutine waiting on a socket (e.g. a nonblocking database connection) holds no worker thread
+        // Each wait is one-shot: the socket is watched from co_await until it is ready once
+        class Reactor {
+        public:
+            Reactor(const Reactor&) = delete;
+            Reactor& operator=(const Reactor&) = delete;
+
+            static Reactor& Instance() {
+                static Reactor* reactor = new Reactor();
+                return *reactor;
+            }
+
+            class Awaiter {
+            public:
+                Awaiter(Reactor& reactor, int fd, uint32_t events) : reactor(reactor), fd(fd), events(events) {}
+
+                bool await_ready() const noexcept {
+                    return false;
+                }
+
+                void await_suspend(std::coroutine_handle<> awaiting) {
+                    this->awaiting = awaiting;
+                    // without a pool to go back to, resume on the blocking pool rather than on the reactor thread
+                    this->resumeOn = ThreadPool::Current() != nullptr ? ThreadPool::Current() : &ThreadPool::Blocking();
+
+#ifdef __linux__
+                    epoll_event event{};
+                    event.events = this->events | EPOLLONESHOT;
+                    event.data.ptr = this;
+
+                    // nothing may touch this awaiter after epoll_ctl: the coroutine can resume before it returns
+                    if (epoll_ctl(this->reactor.epoll, EPOLL_CTL_ADD, this->fd, &event) != 0) {
+                        throw std::runtime_error(std::string("Failed to watch socket: ") + strerror(errno));
+                    }
+#endif
+                }
+
+                void await_resume() const noexcept {}
+
+            private:
+                friend class Reactor;
+
+                Reactor& reactor;
+                int fd;
+                uint32_t events;
+                std::coroutine_handle<> awaiting;
+                ThreadPool* resumeOn = nullptr;
+            };
+
+#ifdef __linux__
+            // co_await Readable(fd) resumes once fd has data to read, or has failed
+            Awaiter Readable(int fd) {
+                return Awaiter(*this, fd, EPOLLIN);
+            }
+
+            // co_await Writable(fd) resumes once fd can take more data, or has failed
+            Awaiter Writable(int fd) {
+                return Awaiter(*this, fd, EPOLLOUT);
+            }
+#endif
+
+        private:
+            Reactor() {
+#ifdef __linux__
+                this->epoll = epoll_create1(EPOLL_CLOEXEC);
+                if (this->epoll < 0) {
+                    throw std::runtime_error(std::string("Failed to create epoll instance: ") + strerror(errno));
+                }
+
+                std::thread([this]() { this->Run(); }).detach();
+#endif
+            }
+
+            void Run() {
+#ifdef __linux__
+                epoll_event events[64];
+
+                while (true) {
+                    int ready = epoll_wait(this->epoll, events, 64, -1);
+
+                    for (int i = 0; i < ready; ++i) {
+                        Awaiter* awaiter = static_cast<Awaiter*>(events[i].data.ptr);
+
+                        // stop watching before the coroutine resumes, it may wait on the same socket again
+                        epoll_ctl(this->epoll, EPOLL_CTL_DEL, awaiter->fd, nullptr);
+
+                        std::coroutine_handle<> awaiting = awaiter->awaiting;
+                        awaiter->resumeOn->Post([awaiting]() { awaiting.resume(); });
+                    }
+                }
+#endif
+            }
+
+            int epoll = -1;
+        };
+    }
+}
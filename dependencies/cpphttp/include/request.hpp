@@ -7,6 +7,7 @@
 #include <iostream>
 #include <sstream>
 #include <regex>
+#include <any>
 #include "ctre.hpp"
 
 #ifdef _WIN32 || _WIN64 || _MSC_VER
@@ -82,6 +83,9 @@ namespace CppHttp {
 			std::string body;
 			std::u8string uoriginal;
 			std::u8string ubody;
+
+			// Set by router middleware, e.g. the authenticated user
+			std::any principal;
 		};
 		
 		class Request {
@@ -0,0 +1,259 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <ctime>
+#include <cstring>
+#include <cstdio>
+#include <iostream>
+#include <syncstream>
+#include "responsetype.hpp"
+#include "nlohmann/json.hpp"
+
+#if defined(_WIN32) || defined(_WIN64) || defined(_MSC_VER)
+	#define WIN32_LEAN_AND_MEAN
+	#define _WINSOCK_DEPRECATED_NO_WARNINGS
+	#include <Windows.h>
+	#include <WinSock2.h>
+	#include <WS2tcpip.h>
+#elif defined(__linux__) || defined(__APPLE__)
+	#include <sys/socket.h>
+	#include <sys/uio.h>
+	#include <errno.h>
+	#ifndef SOCKET
+		#define SOCKET int
+	#endif
+#endif
+
+namespace CppHttp {
+	namespace Net {
+		// Writes responses as a pre-rendered header block (status line, CORS, Content-Type),
+		// a small per-response tail (Date, Content-Length) and the body, in a single vectored send
+		class ResponseWriter {
+		public:
+			// headers, if given, are extra "Name: value" lines; they are also exposed to cross-origin scripts
+			static bool Write(SOCKET socket, ResponseType type, const std::string& data, const std::vector<std::string>* headers = nullptr) {
+				const HeaderBlock& block = ResponseWriter::Block(type);
+
+				std::string extra;
+				if (headers != nullptr && !headers->empty()) {
+					std::string exposed;
+					for (auto& header : *headers) {
+						extra += header;
+						extra += "\r\n";
+
+						if (!exposed.empty()) {
+							exposed += ", ";
+						}
+						exposed += header.substr(0, header.find(':'));
+					}
+					extra += "Access-Control-Expose-Headers: " + exposed + "\r\n";
+				}
+
+				std::string location;
+				std::string errorBody;
+				std::string_view body = data;
+
+				if (type == ResponseType::REDIRECT) {
+					location = "Location: " + data + "\r\n";
+				}
+				else if (block.wrapsBody) {
+					nlohmann::json j;
+					j["data"] = data;
+					errorBody = j.dump();
+					body = errorBody;
+				}
+
+				char tail[128];
+				int tailLength = std::snprintf(tail, sizeof(tail), "%sContent-Length: %zu\r\n\r\n", ResponseWriter::Date(), body.size());
+
+				std::string_view parts[] = {
+					block.header,
+					extra,
+					location,
+					std::string_view(tail, tailLength),
+					body
+				};
+
+				return ResponseWriter::SendAll(socket, parts, sizeof(parts) / sizeof(parts[0]));
+			}
+
+			// Renders the full header block for a CORS preflight answer, minus Date and Content-Length
+			static std::string RenderPreflight(const std::string& methods, int maxAge, const std::string& extraHeaders = "") {
+				std::string header = "HTTP/1.1 204 No Content\r\n";
+				header += "Access-Control-Allow-Origin: *\r\n";
+				header += "Access-Control-Allow-Methods: " + methods + "\r\n";
+				header += "Access-Control-Allow-Headers: X-PINGOTHER, Content-Type, Authorization" + extraHeaders + "\r\n";
+				header += "Access-Control-Max-Age: " + std::to_string(maxAge) + "\r\n";
+				header += "Allow: " + methods + "\r\n";
+				header += "Connection: Keep-Alive\r\n";
+
+				return header;
+			}
+
+			static bool WritePreflight(SOCKET socket, const std::string& block) {
+				char tail[128];
+				int tailLength = std::snprintf(tail, sizeof(tail), "%sContent-Length: 0\r\n\r\n", ResponseWriter::Date());
+
+				std::string_view parts[] = {
+					block,
+					std::string_view(tail, tailLength)
+				};
+
+				return ResponseWriter::SendAll(socket, parts, sizeof(parts) / sizeof(parts[0]));
+			}
+
+		private:
+			struct HeaderBlock {
+				std::string header;
+				bool wrapsBody;
+			};
+
+			static HeaderBlock Render(const char* status, const char* contentType, bool wrapsBody) {
+				std::string header = "HTTP/1.1 ";
+				header += status;
+				header += "\r\n";
+				header += "Access-Control-Allow-Origin: *\r\n";
+				header += "Access-Control-Allow-Methods: GET, POST, PUT, DELETE\r\n";
+				header += "Access-Control-Allow-Headers: X-PINGOTHER, Content-Type, Authorization\r\n";
+				if (contentType != nullptr) {
+					header += "Content-Type: ";
+					header += contentType;
+					header += "\r\n";
+				}
+				header += "Connection: Keep-Alive\r\n";
+
+				return { std::move(header), wrapsBody };
+			}
+
+			static const HeaderBlock& Block(ResponseType type) {
+				static const HeaderBlock okBlock = Render("200 OK", "text/plain", false);
+				static const HeaderBlock jsonBlock = Render("200 OK", "application/json", false);
+				static const HeaderBlock htmlBlock = Render("200 OK", "text/html", false);
+				static const HeaderBlock createdBlock = Render("201 Created", "text/plain", false);
+				static const HeaderBlock badRequestBlock = Render("400 Bad Request", "application/json", true);
+				static const HeaderBlock notAuthorizedBlock = Render("401 Unauthorized", "application/json", true);
+				static const HeaderBlock forbiddenBlock = Render("403 Forbidden", "application/json", true);
+				static const HeaderBlock notFoundBlock = Render("404 Not Found", "application/json", true);
+				static const HeaderBlock alreadyExistsBlock = Render("409 Conflict", "application/json", true);
+				static const HeaderBlock internalErrorBlock = Render("500 Internal Server Error", "application/json", true);
+				static const HeaderBlock notImplementedBlock = Render("501 Not Implemented", "application/json", true);
+				static const HeaderBlock redirectBlock = Render("302 Found", nullptr, false);
+
+				switch (type) {
+				case ResponseType::JSON: return jsonBlock;
+				case ResponseType::HTML: return htmlBlock;
+				case ResponseType::CREATED: return createdBlock;
+				case ResponseType::BAD_REQUEST: return badRequestBlock;
+				case ResponseType::NOT_AUTHORIZED: return notAuthorizedBlock;
+				case ResponseType::FORBIDDEN: return forbiddenBlock;
+				case ResponseType::NOT_FOUND: return notFoundBlock;
+				case ResponseType::ALREADY_EXISTS: return alreadyExistsBlock;
+				case ResponseType::INTERNAL_ERROR: return internalErrorBlock;
+				case ResponseType::NOT_IMPLEMENTED: return notImplementedBlock;
+				case ResponseType::REDIRECT: return redirectBlock;
+				default: return okBlock;
+				}
+			}
+
+			// "Date: <IMF-fixdate>\r\n", re-formatted at most once per second per thread
+			static const char* Date() {
+				thread_local std::time_t cachedSecond = 0;
+				thread_local char cached[64] = "";
+
+				std::time_t now = std::time(nullptr);
+				if (now != cachedSecond) {
+					std::tm tm = {};
+#if defined(_WIN32) || defined(_WIN64) || defined(_MSC_VER)
+					gmtime_s(&tm, &now);
+#else
+					gmtime_r(&now, &tm);
+#endif
+					std::strftime(cached, sizeof(cached), "Date: %a, %d %b %Y %H:%M:%S GMT\r\n", &tm);
+					cachedSecond = now;
+				}
+
+				return cached;
+			}
+
+			static void LogSendError() {
+				std::osyncstream(std::cout) << "\033[31m[-] Failed to send message...\033[0m\n";
+#if defined(_WIN32) || defined(_WIN64) || defined(_MSC_VER)
+				std::osyncstream(std::cout) << "\033[31m[-] Error code: " << WSAGetLastError() << "\033[0m\n";
+#else
+				std::osyncstream(std::cout) << "\033[31m[-] Error code: " << errno << "\033[0m\n";
+				std::osyncstream(std::cout) << "\033[31m[-] Error message: " << strerror(errno) << "\033[0m\n";
+#endif
+			}
+
+#if defined(_WIN32) || defined(_WIN64) || defined(_MSC_VER)
+			static bool SendAll(SOCKET socket, std::string_view* parts, size_t count) {
+				std::string buffer;
+				for (size_t i = 0; i < count; ++i) {
+					buffer.append(parts[i]);
+				}
+
+				size_t totalBytesSent = 0;
+				while (totalBytesSent < buffer.size()) {
+					int bytesSent = send(socket, buffer.data() + totalBytesSent, (int)(buffer.size() - totalBytesSent), 0);
+					if (bytesSent == SOCKET_ERROR) {
+						ResponseWriter::LogSendError();
+						return false;
+					}
+					totalBytesSent += bytesSent;
+				}
+
+				return true;
+			}
+#else
+			static bool SendAll(SOCKET socket, std::string_view* parts, size_t count) {
+				iovec iov[8];
+				int iovCount = 0;
+				for (size_t i = 0; i < count && iovCount < 8; ++i) {
+					if (parts[i].empty()) {
+						continue;
+					}
+					iov[iovCount].iov_base = const_cast<char*>(parts[i].data());
+					iov[iovCount].iov_len = parts[i].size();
+					++iovCount;
+				}
+
+				iovec* current = iov;
+				while (iovCount > 0) {
+					msghdr msg = {};
+					msg.msg_iov = current;
+					msg.msg_iovlen = iovCount;
+
+#ifdef MSG_NOSIGNAL
+					ssize_t bytesSent = sendmsg(socket, &msg, MSG_NOSIGNAL);
+#else
+					ssize_t bytesSent = sendmsg(socket, &msg, 0);
+#endif
+					if (bytesSent < 0) {
+						if (errno == EINTR) {
+							continue;
+						}
+						ResponseWriter::LogSendError();
+						return false;
+					}
+
+					// skip the buffers that were fully written and advance into a partially written one
+					size_t remaining = (size_t)bytesSent;
+					while (iovCount > 0 && remaining >= current->iov_len) {
+						remaining -= current->iov_len;
+						++current;
+						--iovCount;
+					}
+					if (iovCount > 0) {
+						current->iov_base = static_cast<char*>(current->iov_base) + remaining;
+						current->iov_len -= remaining;
+					}
+				}
+
+				return true;
+			}
+#endif
+		};
+	}
+}
@@ -0,0 +1,38 @@
+#pragma once
+#include <functional>
+#include <string>
+#include <vector>
+#include <utility>
+
+// Single-handler counterpart to Event: a route only ever has one callback,
+// so it is called directly instead of collecting results into a vector
+template <typename FuncReturnType, typename... Args>
+class Route {
+public:
+    using FuncType = std::function<FuncReturnType(Args...)>;
+
+    Route() = default;
+
+    explicit Route(FuncType func) : m_Handler(std::move(func)) {}
+
+    FuncReturnType Invoke(Args... args) const {
+        return this->m_Handler(std::forward<Args>(args)...);
+    }
+
+    explicit operator bool() const {
+        return static_cast<bool>(this->m_Handler);
+    }
+
+private:
+    FuncType m_Handler;
+};
+
+// Route with path parameters, e.g. "/assignment/{assignment_id}/get"
+// The pattern is split into segments once when the route is added
+template <typename Entry>
+struct ParamRoute {
+    std::string method;
+    std::string path;
+    std::vector<std::string> segments;
+    Entry entry;
+};
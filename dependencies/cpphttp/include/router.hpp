@@ -9,9 +9,11 @@
 #include <optional>
 #include <unordered_map>
 #include <syncstream>
-#include "event.hpp"
+#include "route.hpp"
+#include "task.hpp"
 #include "request.hpp"
 #include "responsetype.hpp"
+#include "responsewriter.hpp"
 #include "nlohmann/json.hpp"
 
 #ifdef __linux__ || __APPLE__
@@ -26,6 +28,21 @@ namespace CppHttp {
 			using returnType = std::tuple<ResponseType, std::string, std::optional<std::vector<std::string>>>;
 
 		public:
+			// Runs before the route handler; returning a response short-circuits the chain and the handler
+			using Middleware = std::function<std::optional<returnType>(Request&)>;
+
+			// Middleware that co_awaits, e.g. a database lookup, instead of blocking the worker it runs on
+			using AsyncMiddleware = std::function<Task<std::optional<returnType>>(Request&)>;
+
+			// Runs after a matched route produced its response, e.g. to record per-request statistics
+			using ResponseObserver = std::function<void(Request&, const returnType&)>;
+
+			// Public routes skip the middleware, e.g. authentication, and go straight to their handler
+			enum class Access {
+				PROTECTED,
+				PUBLIC
+			};
+
 			void Handle(Request& req) {
 				std::cout << "\033[1;32m[+] Requested path: " << req.m_info.route << "\033[0m\n";
 
@@ -50,291 +67,311 @@ namespace CppHttp {
 				std::cout << "\033[0m";
 #endif
 
-				std::string method = req.m_info.method;
+				if (this->AnswerPreflight(req)) {
+					return;
+				}
 
-				std::vector<returnType> responses;
 				returnType response = { ResponseType::OK, "", {} };
 
-				if (this->get.contains(req.m_info.route) || this->post.contains(req.m_info.route) || this->put.contains(req.m_info.route) || this->del.contains(req.m_info.route)) {
+				const Endpoint* endpoint = this->Match(req);
+
+				if (endpoint != nullptr) {
 					try {
-						if (method == "GET") {
-							responses = this->get[req.m_info.route].Invoke(req);
-						}
-						else if (method == "POST") {
-							responses = this->post[req.m_info.route].Invoke(req);
+						// SyncWait keeps this worker running the pool's queue, so the tasks can resume on it
+						std::optional<returnType> rejected = SyncWait(this->RunMiddleware(req, *endpoint));
+						if (rejected.has_value()) {
+							response = std::move(*rejected);
 						}
-						else if (method == "PUT") {
-							responses = this->put[req.m_info.route].Invoke(req);
+						else if (endpoint->asyncHandler) {
+							response = SyncWait(endpoint->asyncHandler.Invoke(req));
 						}
-						else if (method == "DELETE") {
-							responses = this->del[req.m_info.route].Invoke(req);
+						else {
+							response = endpoint->handler.Invoke(req);
 						}
 					}
 					catch (std::exception& e) {
-						responses = { { ResponseType::INTERNAL_ERROR, e.what(), {} } };
+						response = { ResponseType::INTERNAL_ERROR, e.what(), {} };
 					}
 
-					for (auto& res : responses) {
-						response = res;
-					}
+					this->Observe(req, response);
 				}
-				else {
-					for (auto [path, pair] : paramRoutes) {
-						if (pair.second != method) {
-							continue;
-						}
 
-						bool foundMatch = false;
+				this->Respond(req, response);
+			}
 
-						// split path by '/'
-						std::vector<std::string> pathSplit = CppHttp::Utils::Split(path, '/');
+			// Coroutine counterpart of Handle: awaits asynchronous handlers instead of blocking on them
+			// Owns the request for as long as the handler runs
+			Task<void> HandleAsync(Request req) {
+				std::cout << "\033[1;32m[+] Requested path: " << req.m_info.route << "\033[0m\n";
 
-						// find index of element in pathSplit that begins with '{'
-						std::vector<std::vector<std::string>::iterator> indexes;
+				if (this->AnswerPreflight(req)) {
+					co_return;
+				}
 
-						for (auto it = pathSplit.begin(); it != pathSplit.end(); ++it) {
-							if ((*it)[0] == '{') {
-								indexes.push_back(it);
-							}
-						}
-						
-						for (auto it : indexes) {
-							// get index of element
-							int index = std::distance(pathSplit.begin(), it);
-
-							// split route by '/'
-							std::vector<std::string> routeSplit = CppHttp::Utils::Split(req.m_info.route, '/');
-
-							// if routeSplit size is not equal to pathSplit size, continue
-							if (routeSplit.size() != pathSplit.size()) {
-								continue;
-							}
-
-							// check if left side of path (before '{') is equal to left side of route (before the potential parameter value)
-							bool leftSideMatch = true;
-
-							for (int i = 0; i < index; ++i) {
-								if (pathSplit[i][0] == '{') {
-									continue;
-								}
-								if (pathSplit[i] != routeSplit[i]) {
-									leftSideMatch = false;
-									break;
-								}
-							}
-
-							// check if right side of path (after '}') is equal to right side of route (after the potential parameter value)
-							bool rightSideMatch = true;
-
-							for (int i = index + 1; i < pathSplit.size(); ++i) {
-								if (pathSplit[i][0] == '{') {
-									continue;
-								}
-								if (pathSplit[i] != routeSplit[i]) {
-									rightSideMatch = false;
-									break;
-								}
-							}
-
-							if (!leftSideMatch || !rightSideMatch) {
-								continue;
-							}
-
-							// get parameter value
-							std::string parameterValue = routeSplit[index];
-
-							// get parameter name (have to remove '{' and '}')
-							std::string parameterName = pathSplit[index].substr(1, pathSplit[index].size() - 2);
-
-							// add parameter and value to request parameters map
-							req.m_info.parameters[parameterName] = parameterValue;
-
-							foundMatch = true;
-						}
-						if (!foundMatch) {
-							continue;
-						}
+				returnType response = { ResponseType::OK, "", {} };
+
+				const Endpoint* endpoint = this->Match(req);
 
-						try {
-							responses = pair.first.Invoke(req);
+				if (endpoint != nullptr) {
+					try {
+						std::optional<returnType> rejected = co_await this->RunMiddleware(req, *endpoint);
+						if (rejected.has_value()) {
+							response = std::move(*rejected);
 						}
-						catch (std::exception& e) {
-							responses = { { ResponseType::INTERNAL_ERROR, e.what(), {} } };
+						else if (endpoint->asyncHandler) {
+							response = co_await endpoint->asyncHandler.Invoke(req);
 						}
-
-						for (auto& res : responses) {
-							response = res;
+						else {
+							response = endpoint->handler.Invoke(req);
 						}
 					}
+					catch (std::exception& e) {
+						response = { ResponseType::INTERNAL_ERROR, e.what(), {} };
+					}
+
+					this->Observe(req, response);
 				}
 
 				this->Respond(req, response);
 			}
 
-			void AddRoute(std::string method, std::string path, std::function<returnType(Request&)> callback) {
+			void AddRoute(std::string method, std::string path, std::function<returnType(Request&)> callback, Access access = Access::PROTECTED) {
+				Endpoint endpoint;
+				endpoint.handler = Route<returnType, CppHttp::Net::Request&>(std::move(callback));
+				endpoint.access = access;
+				this->AddEndpoint(std::move(method), std::move(path), std::move(endpoint));
+			}
+
+			// Route whose handler is a coroutine, e.g. one that co_awaits Offload(...) for its database calls
+			void AddRoute(std::string method, std::string path, std::function<Task<returnType>(Request&)> callback, Access access = Access::PROTECTED) {
+				Endpoint endpoint;
+				endpoint.asyncHandler = Route<Task<returnType>, CppHttp::Net::Request&>(std::move(callback));
+				endpoint.access = access;
+				this->AddEndpoint(std::move(method), std::move(path), std::move(endpoint));
+			}
+
+			// Middleware runs in the order it was added, only for requests that matched a route that is not public
+			void Use(Middleware middleware) {
+				this->middleware.push_back({ std::move(middleware), {} });
+			}
+
+			void Use(AsyncMiddleware middleware) {
+				this->middleware.push_back({ {}, std::move(middleware) });
+			}
+
+			// Observers run in the order they were added, only for requests that matched a route
+			void OnResponse(ResponseObserver observer) {
+				this->observers.push_back(std::move(observer));
+			}
+
+			// How long browsers may cache preflight answers, in seconds
+			// Applies to routes added after the call
+			void SetPreflightMaxAge(int seconds) {
+				this->preflightMaxAge = seconds;
+			}
+
+			// Request header cross-origin clients may send besides Content-Type and Authorization
+			// Applies to routes added after the call
+			void AllowRequestHeader(const std::string& name) {
+				this->allowedHeaders += ", " + name;
+			}
+
+		private:
+			// Exactly one of the two handlers is set
+			struct Endpoint {
+				Route<returnType, CppHttp::Net::Request&> handler;
+				Route<Task<returnType>, CppHttp::Net::Request&> asyncHandler;
+				Access access = Access::PROTECTED;
+			};
+
+			using RouteMap = std::unordered_map<std::string, Endpoint>;
+
+			RouteMap get;
+			RouteMap post;
+			RouteMap put;
+			RouteMap del;
+
+			std::vector<ParamRoute<Endpoint>> paramRoutes;
+
+			// Exactly one of the two is set
+			struct Stage {
+				Middleware handler;
+				AsyncMiddleware asyncHandler;
+			};
+
+			std::vector<Stage> middleware;
+			std::vector<ResponseObserver> observers;
+
+			// route pattern -> registered methods and the pre-rendered preflight header block
+			std::unordered_map<std::string, std::pair<std::string, std::string>> preflights;
+			int preflightMaxAge = 86400;
+			std::string allowedHeaders;
+
+			void AddEndpoint(std::string method, std::string path, Endpoint endpoint) {
 				for (auto& c : method) {
 					c = toupper(c);
 				}
 
+				this->AddAllowedMethod(path, method);
+
 				if (path.find('{') != std::string::npos) {
-					this->paramRoutes[path].first.Attach(callback);
-					this->paramRoutes[path].second = method;
+					std::vector<std::string> segments = CppHttp::Utils::Split(path, '/');
+					this->paramRoutes.push_back({ std::move(method), std::move(path), std::move(segments), std::move(endpoint) });
+					return;
 				}
-				else {
-					if (method == "GET") {
-						this->get[path].Attach(callback);
-					}
-					else if (method == "POST") {
-						this->post[path].Attach(callback);
-					}
-					else if (method == "PUT") {
-						this->put[path].Attach(callback);
-					}
-					else if (method == "DELETE") {
-						this->del[path].Attach(callback);
-					}
+
+				auto* routes = this->RoutesFor(method);
+				if (routes != nullptr) {
+					(*routes)[path] = std::move(endpoint);
 				}
 			}
 
-		private:
-			std::unordered_map<std::string, Event<returnType, CppHttp::Net::Request&>> get;
-			std::unordered_map<std::string, Event<returnType, CppHttp::Net::Request&>> post;
-			std::unordered_map<std::string, Event<returnType, CppHttp::Net::Request&>> put;
-			std::unordered_map<std::string, Event<returnType, CppHttp::Net::Request&>> del;
+			// Answers CORS preflight requests; returns false for any other method
+			bool AnswerPreflight(Request& req) {
+				if (req.m_info.method != "OPTIONS") {
+					return false;
+				}
 
-			std::unordered_map<std::string, std::pair<Event<returnType, CppHttp::Net::Request&>, std::string>> paramRoutes;
+				const std::string* preflight = this->MatchPreflight(req.m_info.route);
+				if (preflight != nullptr) {
+					ResponseWriter::WritePreflight(req.m_info.sender, *preflight);
+				}
+				else {
+					this->Respond(req, { ResponseType::NOT_FOUND, "Not found", {} });
+				}
 
-			void Respond(Request& req, returnType response) {
-				ResponseType type = std::get<0>(response);
-				std::string data = std::get<1>(response);
-				json j;
+				return true;
+			}
 
-				std::string header = "HTTP/1.1 ";
+			void AddAllowedMethod(const std::string& path, const std::string& method) {
+				auto& [methods, block] = this->preflights[path];
 
-				if (type == ResponseType::OK || type == ResponseType::CREATED || type == ResponseType::JSON || type == ResponseType::HTML || type == ResponseType::TEXT) {
-					if (type != ResponseType::CREATED) {
-						header += "200 OK\r\n";
-					}
-					else {
-						header += "201 Created\r\n";
-					}
+				if (methods.find(method) == std::string::npos) {
+					methods = methods.empty() ? method : methods + ", " + method;
+				}
 
-					// CORS
-					header += "Access-Control-Allow-Origin: *\r\n";
-					header += "Access-Control-Allow-Methods: GET, POST, PUT, DELETE\r\n";
-					header += "Access-Control-Allow-Headers: X-PINGOTHER, Content-Type, Authorization\r\n";
+				block = ResponseWriter::RenderPreflight(methods + ", OPTIONS", this->preflightMaxAge, this->allowedHeaders);
+			}
 
-					header += "Content-Type: ";
+			static bool MatchSegments(const std::vector<std::string>& segments, const std::vector<std::string>& routeSplit) {
+				if (segments.size() != routeSplit.size()) {
+					return false;
+				}
 
-					if (type == ResponseType::JSON) {
-						header += "application/json\r\n";
-					}
-					else if (type == ResponseType::HTML) {
-						header += "text/html\r\n";
-					}
-					else if (type == ResponseType::TEXT) {
-						header += "text/plain\r\n";
+				for (size_t i = 0; i < routeSplit.size(); ++i) {
+					if (segments[i][0] != '{' && segments[i] != routeSplit[i]) {
+						return false;
 					}
 				}
-				else if (type == ResponseType::BAD_REQUEST) {
-					header += "400 Bad Request\r\n";
-					header += "Access-Control-Allow-Origin: *\r\n";
-					header += "Access-Control-Allow-Methods: GET, POST, PUT, DELETE\r\n";
-					header += "Access-Control-Allow-Headers: X-PINGOTHER, Content-Type, Authorization\r\n";
-					header += "Content-Type: application/json\r\n";
-					j["data"] = data;
+
+				return true;
+			}
+
+			// Returns the preflight header block for the route pattern matching the path, or nullptr if nothing is registered for it
+			const std::string* MatchPreflight(const std::string& path) const {
+				auto it = this->preflights.find(path);
+				if (it != this->preflights.end()) {
+					return &it->second.second;
 				}
-				else if (type == ResponseType::NOT_FOUND) {
-					header += "404 Not Found\r\n";
-					header += "Access-Control-Allow-Origin: *\r\n";
-					header += "Access-Control-Allow-Methods: GET, POST, PUT, DELETE\r\n";
-					header += "Access-Control-Allow-Headers: X-PINGOTHER, Content-Type, Authorization\r\n";
-					header += "Content-Type: application/json\r\n";
-					j["data"] = data;
+
+				std::vector<std::string> routeSplit = CppHttp::Utils::Split(path, '/');
+
+				for (auto& paramRoute : this->paramRoutes) {
+					if (Router::MatchSegments(paramRoute.segments, routeSplit)) {
+						return &this->preflights.at(paramRoute.path).second;
+					}
 				}
-				else if (type == ResponseType::INTERNAL_ERROR) {
-					header += "500 Internal Server Error\r\n";
-					header += "Access-Control-Allow-Origin: *\r\n";
-					header += "Access-Control-Allow-Methods: GET, POST, PUT, DELETE\r\n";
-					header += "Access-Control-Allow-Headers: X-PINGOTHER, Content-Type, Authorization\r\n";
-					header += "Content-Type: application/json\r\n";
-
-					j["data"] = data;
+
+				return nullptr;
+			}
+
+			RouteMap* RoutesFor(const std::string& method) {
+				if (method == "GET") {
+					return &this->get;
 				}
-				else if (type == ResponseType::NOT_IMPLEMENTED) {
-					header += "501 Not Implemented\r\n";
-					header += "Access-Control-Allow-Origin: *\r\n";
-					header += "Access-Control-Allow-Methods: GET, POST, PUT, DELETE\r\n";
-					header += "Access-Control-Allow-Headers: X-PINGOTHER, Content-Type, Authorization\r\n";
-					header += "Content-Type: application/json\r\n";
-
-					j["data"] = data;
+				else if (method == "POST") {
+					return &this->post;
 				}
-				else if (type == ResponseType::NOT_AUTHORIZED) {
-					header += "401 Unauthorized\r\n";
-					header += "Access-Control-Allow-Origin: *\r\n";
-					header += "Access-Control-Allow-Methods: GET, POST, PUT, DELETE\r\n";
-					header += "Access-Control-Allow-Headers: X-PINGOTHER, Content-Type, Authorization\r\n";
-					header += "Content-Type: application/json\r\n";
-
-					j["data"] = data;
+				else if (method == "PUT") {
+					return &this->put;
 				}
-				else if (type == ResponseType::FORBIDDEN) {
-					header += "403 Forbidden\r\n";
-					header += "Access-Control-Allow-Origin: *\r\n";
-					header += "Access-Control-Allow-Methods: GET, POST, PUT, DELETE\r\n";
-					header += "Access-Control-Allow-Headers: X-PINGOTHER, Content-Type, Authorization\r\n";
-					header += "Content-Type: application/json\r\n";
-
-					j["data"] = data;
+				else if (method == "DELETE") {
+					return &this->del;
 				}
-				else if (type == ResponseType::REDIRECT) {
-					header += "302 Found\r\n";
-					header += "Access-Control-Allow-Origin: *\r\n";
-					header += "Access-Control-Allow-Methods: GET, POST, PUT, DELETE\r\n";
-					header += "Access-Control-Allow-Headers: X-PINGOTHER, Content-Type, Authorization\r\n";
-					header += "Location: " + data + "\r\n";
+
+				return nullptr;
+			}
+
+			// Finds the handler for the request, filling in path parameters for parameterised routes
+			// Returns nullptr if no route matches
+			const Endpoint* Match(Request& req) {
+				const std::string& method = req.m_info.method;
+				const std::string& path = req.m_info.route;
+
+				auto* routes = this->RoutesFor(method);
+				if (routes != nullptr) {
+					auto it = routes->find(path);
+					if (it != routes->end()) {
+						return &it->second;
+					}
 				}
-				else if (type == ResponseType::ALREADY_EXISTS) {
-					header += "409 Conflict\r\n";
-					header += "Access-Control-Allow-Origin: *\r\n";
-					header += "Access-Control-Allow-Methods: GET, POST, PUT, DELETE\r\n";
-					header += "Access-Control-Allow-Headers: X-PINGOTHER, Content-Type, Authorization\r\n";
-					header += "Content-Type: application/json\r\n";
-
-					j["data"] = data;
+
+				// a static route registered under a different method
+				if (this->get.contains(path) || this->post.contains(path) || this->put.contains(path) || this->del.contains(path)) {
+					return nullptr;
 				}
 
-				header += "Connection: Keep-Alive\r\n";
+				std::vector<std::string> routeSplit = CppHttp::Utils::Split(path, '/');
 
-				if (j["data"].is_null()) {
-					header += "Content-Length: " + std::to_string(data.length()) + "\r\n\r\n";
-					header += data;
+				for (auto& paramRoute : this->paramRoutes) {
+					if (paramRoute.method != method || !Router::MatchSegments(paramRoute.segments, routeSplit)) {
+						continue;
+					}
+
+					for (size_t i = 0; i < routeSplit.size(); ++i) {
+						const std::string& segment = paramRoute.segments[i];
+						if (segment[0] == '{') {
+							// parameter name without '{' and '}'
+							req.m_info.parameters[segment.substr(1, segment.size() - 2)] = std::move(routeSplit[i]);
+						}
+					}
+
+					return &paramRoute.entry;
 				}
-				else {
-					header += "Content-Length: " + std::to_string(j.dump().length()) + "\r\n\r\n";
-					header += j.dump();
 
+				return nullptr;
+			}
+
+			Task<std::optional<returnType>> RunMiddleware(Request& req, const Endpoint& endpoint) const {
+				if (endpoint.access == Access::PUBLIC) {
+					co_return std::nullopt;
 				}
 
-				int bytesSent = 0;
-				int totalBytesSent = 0;
-				while (totalBytesSent < header.size()) {
-					bytesSent = send(req.m_info.sender, header.data(), header.size(), 0);
-					if (bytesSent < 0) {
-						std::cout << "\033[31m[-] Failed to send message...\033[0m\n";
-
-#ifdef _WIN32 || _WIN64 || _MSC_VER
-						std::cout << "\033[31m[-] Error code: " << WSAGetLastError() << "\033[0m\n";
-#elif defined(__linux__) || defined(__APPLE__)
-						std::cout << "\033[31m[-] Error code: " << errno << "\033[0m\n";
-						std::cout << "\033[31m[-] Error message: " << strerror(errno) << "\033[0m\n";
-#endif
+				for (auto& stage : this->middleware) {
+					std::optional<returnType> response = stage.asyncHandler ? co_await stage.asyncHandler(req) : stage.handler(req);
+					if (response.has_value()) {
+						co_return response;
 					}
+				}
+
+				co_return std::nullopt;
+			}
 
-					totalBytesSent += bytesSent;
+			void Observe(Request& req, const returnType& response) const {
+				for (auto& observer : this->observers) {
+					try {
+						observer(req, response);
+					}
+					catch (std::exception& e) {
+						std::osyncstream(std::cout) << "\033[31m[-] Response observer failed: " << e.what() << "\033[0m\n";
+					}
 				}
 			}
+
+			void Respond(Request& req, const returnType& response) {
+				const std::optional<std::vector<std::string>>& headers = std::get<2>(response);
+				ResponseWriter::Write(req.m_info.sender, std::get<0>(response), std::get<1>(response), headers.has_value() ? &*headers : nullptr);
+			}
 		};
 	}
 }
\ No newline at end of file
@@ -0,0 +1,319 @@
+#pragma once
+#include <atomic>
+#include <coroutine>
+#include <exception>
+#include <future>
+#include <iostream>
+#include <optional>
+#include <syncstream>
+#include <type_traits>
+#include <utility>
+#include <variant>
+#include "threadpool.hpp"
+
+namespace CppHttp {
+    namespace Net {
+        template <typename T>
+        class Task;
+
+        namespace Detail {
+            struct PromiseBase {
+                std::coroutine_handle<> continuation;
+                std::exception_ptr exception;
+
+                std::suspend_always initial_suspend() noexcept {
+                    return {};
+                }
+
+                // resume whoever awaited the task, if anyone
+                struct FinalAwaiter {
+                    bool await_ready() noexcept {
+                        return false;
+                    }
+
+                    template <typename Promise>
+                    std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> handle) noexcept {
+                        std::coroutine_handle<> continuation = handle.promise().continuation;
+                        return continuation ? continuation : std::noop_coroutine();
+                    }
+
+                    void await_resume() noexcept {}
+                };
+
+                FinalAwaiter final_suspend() noexcept {
+                    return {};
+                }
+
+                void unhandled_exception() noexcept {
+                    this->exception = std::current_exception();
+                }
+            };
+
+            template <typename T>
+            struct Promise : PromiseBase {
+                std::optional<T> value;
+
+                Task<T> get_return_object() noexcept;
+
+                template <typename U>
+                void return_value(U&& value) {
+                    this->value.emplace(std::forward<U>(value));
+                }
+
+                T Result() {
+                    if (this->exception) {
+                        std::rethrow_exception(this->exception);
+                    }
+                    return std::move(*this->value);
+                }
+            };
+
+            template <>
+            struct Promise<void> : PromiseBase {
+                Task<void> get_return_object() noexcept;
+
+                void return_void() noexcept {}
+
+                void Result() {
+                    if (this->exception) {
+                        std::rethrow_exception(this->exception);
+                    }
+                }
+            };
+
+            // Eagerly started coroutine nobody awaits; owns itself and frees its frame on completion
+            struct DetachedTask {
+                struct promise_type {
+                    DetachedTask get_return_object() noexcept {
+                        return {};
+                    }
+
+                    std::suspend_never initial_suspend() noexcept {
+                        return {};
+                    }
+
+                    std::suspend_never final_suspend() noexcept {
+                        return {};
+                    }
+
+                    void return_void() noexcept {}
+
+                    void unhandled_exception() noexcept {
+                        std::terminate();
+                    }
+                };
+            };
+        }
+
+        // Lazily started coroutine producing a T; runs when awaited
+        template <typename T = void>
+        class Task {
+        public:
+            using promise_type = Detail::Promise<T>;
+
+            Task() = default;
+
+            explicit Task(std::coroutine_handle<promise_type> handle) : handle(handle) {}
+
+            Task(Task&& other) noexcept : handle(std::exchange(other.handle, nullptr)) {}
+
+            Task& operator=(Task&& other) noexcept {
+                if (this != &other) {
+                    if (this->handle) {
+                        this->handle.destroy();
+                    }
+                    this->handle = std::exchange(other.handle, nullptr);
+                }
+                return *this;
+            }
+
+            Task(const Task&) = delete;
+            Task& operator=(const Task&) = delete;
+
+            ~Task() {
+                if (this->handle) {
+                    this->handle.destroy();
+                }
+            }
+
+            auto operator co_await() && noexcept {
+                struct Awaiter {
+                    std::coroutine_handle<promise_type> handle;
+
+                    bool await_ready() const noexcept {
+                        return !this->handle || this->handle.done();
+                    }
+
+                    std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept {
+                        this->handle.promise().continuation = awaiting;
+                        return this->handle;
+                    }
+
+                    T await_resume() {
+                        return this->handle.promise().Result();
+                    }
+                };
+
+                return Awaiter{ this->handle };
+            }
+
+        private:
+            std::coroutine_handle<promise_type> handle = nullptr;
+        };
+
+        namespace Detail {
+            template <typename T>
+            Task<T> Promise<T>::get_return_object() noexcept {
+                return Task<T>(std::coroutine_handle<Promise<T>>::from_promise(*this));
+            }
+
+            inline Task<void> Promise<void>::get_return_object() noexcept {
+                return Task<void>(std::coroutine_handle<Promise<void>>::from_promise(*this));
+            }
+
+            template <typename Fn>
+            class OffloadAwaiter {
+                using Result = std::invoke_result_t<Fn&>;
+                using Storage = std::conditional_t<std::is_void_v<Result>, std::monostate, Result>;
+
+            public:
+                OffloadAwaiter(ThreadPool& pool, Fn fn) : pool(pool), fn(std::move(fn)) {}
+
+                bool await_ready() const noexcept {
+                    return false;
+                }
+
+                void await_suspend(std::coroutine_handle<> awaiting) {
+                    ThreadPool* resumeOn = ThreadPool::Current();
+
+                    // nothing may touch this awaiter after Post: the coroutine can resume before it returns
+                    this->pool.Post([this, awaiting, resumeOn]() {
+                        try {
+                            if constexpr (std::is_void_v<Result>) {
+                                this->fn();
+                                this->result.emplace();
+                            }
+                            else {
+                                this->result.emplace(this->fn());
+                            }
+                        }
+                        catch (...) {
+                            this->exception = std::current_exception();
+                        }
+
+                        if (resumeOn != nullptr) {
+                            resumeOn->Post([awaiting]() { awaiting.resume(); });
+                        }
+                        else {
+                            awaiting.resume();
+                        }
+                    });
+                }
+
+                Result await_resume() {
+                    if (this->exception) {
+                        std::rethrow_exception(this->exception);
+                    }
+                    if constexpr (!std::is_void_v<Result>) {
+                        return std::move(*this->result);
+                    }
+                }
+
+            private:
+                ThreadPool& pool;
+                Fn fn;
+                std::optional<Storage> result;
+                std::exception_ptr exception;
+            };
+        }
+
+        // co_await Offload(fn) runs a blocking call on the blocking pool and resumes the awaiting
+        // coroutine back on the pool it was running on, leaving that thread free in the meantime
+        template <typename Fn>
+        Detail::OffloadAwaiter<Fn> Offload(Fn fn) {
+            return Detail::OffloadAwaiter<Fn>(ThreadPool::Blocking(), std::move(fn));
+        }
+
+        template <typename Fn>
+        Detail::OffloadAwaiter<Fn> Offload(ThreadPool& pool, Fn fn) {
+            return Detail::OffloadAwaiter<Fn>(pool, std::move(fn));
+        }
+
+        // Starts a task without waiting for it; the task's frame is released when it finishes
+        inline Detail::DetachedTask Spawn(Task<void> task) {
+            try {
+                co_await std::move(task);
+            }
+            catch (std::exception& e) {
+                std::osyncstream(std::cout) << "\033[31m[-] Unhandled error in task: " << e.what() << "\033[0m\n";
+            }
+            catch (...) {
+                std::osyncstream(std::cout) << "\033[31m[-] Unhandled error in task\033[0m\n";
+            }
+        }
+
+        // Blocks the calling thread until the task finishes
+        // On a pool worker the thread keeps running the pool's queue meanwhile: the task may be resumed on that pool,
+        // and a worker that only waited could leave it with no thread to do so
+        template <typename T>
+        T SyncWait(Task<T> task) {
+            ThreadPool* pool = ThreadPool::Current();
+
+            if (pool == nullptr) {
+                std::promise<T> promise;
+                std::future<T> future = promise.get_future();
+
+                [](Task<T> task, std::promise<T>& promise) -> Detail::DetachedTask {
+                    try {
+                        if constexpr (std::is_void_v<T>) {
+                            co_await std::move(task);
+                            promise.set_value();
+                        }
+                        else {
+                            promise.set_value(co_await std::move(task));
+                        }
+                    }
+                    catch (...) {
+                        promise.set_exception(std::current_exception());
+                    }
+                }(std::move(task), promise);
+
+                return future.get();
+            }
+
+            using Storage = std::conditional_t<std::is_void_v<T>, std::monostate, T>;
+
+            std::optional<Storage> result;
+            std::exception_ptr exception;
+            std::atomic<bool> done = false;
+
+            // after done is set the waiting thread may return at once, so only the pool is touched from then on
+            [](Task<T> task, std::optional<Storage>& result, std::exception_ptr& exception, std::atomic<bool>& done, ThreadPool* pool) -> Detail::DetachedTask {
+                try {
+                    if constexpr (std::is_void_v<T>) {
+                        co_await std::move(task);
+                        result.emplace();
+                    }
+                    else {
+                        result.emplace(co_await std::move(task));
+                    }
+                }
+                catch (...) {
+                    exception = std::current_exception();
+                }
+
+                done.store(true, std::memory_order_release);
+                pool->Wake();
+            }(std::move(task), result, exception, done, pool);
+
+            pool->RunUntil([&done]() { return done.load(std::memory_order_acquire); });
+
+            if (exception) {
+                std::rethrow_exception(exception);
+            }
+            if constexpr (!std::is_void_v<T>) {
+                return std::move(*result);
+            }
+        }
+    }
+}
@@ -1,15 +1,14 @@
 #include "debug.hpp"
 #include "event.hpp"
 #include "router.hpp"
+#include "task.hpp"
+#include "threadpool.hpp"
 #include <iostream>
 #include <functional>
 #include <thread>
 #include <stdexcept>
 #include <string>
-#include <future>
-#include <queue>
-#include <mutex>
-#include <condition_variable>
+#include <memory>
 #include <syncstream>
 #include <fstream>
 
@@ -140,6 +139,12 @@ namespace CppHttp {
                 this->onReceive.Attach(callback);
             }
 
+            // Coroutine receive handler, e.g. Router::HandleAsync; takes over the request, and the
+            // connection is closed once the returned task finishes rather than when it first suspends
+            void SetOnReceiveAsync(std::function<Task<void>(Request)> callback) {
+                this->onReceiveAsync = std::move(callback);
+            }
+
             void SetBlocking(bool blocking) {
 #ifdef WINDOWS
                 u_long mode = blocking ? 0 : 1;
@@ -170,28 +175,32 @@ namespace CppHttp {
             Event<void, SOCKET> onConnect;
             Event<void, SOCKET> onDisconnect;
             Event<void, Request&> onReceive;
+            std::function<Task<void>(Request)> onReceiveAsync;
 
-            std::vector<std::future<void>> futures;
-            std::queue<std::function<void()>> tasks;
-            std::vector<std::thread> threads;
-            std::mutex queueMutex;
-            std::condition_variable condition;
+            std::unique_ptr<ThreadPool> pool;
 
             void InitThreadPool(const int maxConnections) {
-                for (int i = 0; i < maxConnections; ++i) {
-                    threads.emplace_back([this]() {
-                        while (true) {
-                            std::function<void()> task;
-                            {
-                                std::unique_lock<std::mutex> lock(queueMutex);
-                                condition.wait(lock, [this]() { return !tasks.empty(); });
-                                task = std::move(tasks.front());
-                                tasks.pop();
-                            }
-                            task();
+                this->pool = std::make_unique<ThreadPool>(maxConnections);
+            }
+
+            Task<void> ServeAsync(Request req, SOCKET connection) {
+                // closes the connection however the request ends
+                struct Close {
+                    TcpListener* listener;
+                    SOCKET connection;
+
+                    ~Close() {
+                        try {
+                            this->listener->onDisconnect.Invoke(this->connection);
                         }
-                        });
-                }
+                        catch (...) {
+                            std::osyncstream(std::cout) << "\033[31m[-] Disconnect handler failed\033[0m\n";
+                        }
+                        closesocket(this->connection);
+                    }
+                } close{ this, connection };
+
+                co_await this->onReceiveAsync(std::move(req));
             }
 
             void Accept() {
@@ -212,8 +221,7 @@ namespace CppHttp {
                 }
 
 
-                std::unique_lock<std::mutex> lock(queueMutex);
-                tasks.push([this, newConnection]() {
+                this->pool->Post([this, newConnection]() {
                     std::osyncstream(std::osyncstream(std::cout)) << "\033[1;32m[+] Accepted new connection...\033[0m\n";
                     this->onConnect.Invoke(newConnection);
 
@@ -304,14 +312,16 @@ namespace CppHttp {
                     req.m_info.ubody = CppHttp::Utils::GetU8Body(buffer.get(), bytesReceived);
                     req.m_info.uoriginal = std::u8string(buffer.get(), buffer.get() + bytesReceived);
 
+                    if (this->onReceiveAsync) {
+                        Spawn(this->ServeAsync(std::move(req), newConnection));
+                        return;
+                    }
+
                     this->onReceive.Invoke(req);
 
                     this->onDisconnect.Invoke(newConnection);
                     closesocket(newConnection);
                 });
-
-                lock.unlock();
-                condition.notify_one();
             }
 
             #ifdef WINDOWS
@@ -0,0 +1,114 @@
+#pragma once
+#include <algorithm>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+namespace CppHttp {
+    namespace Net {
+        class ThreadPool {
+        public:
+            explicit ThreadPool(size_t threadCount) {
+                for (size_t i = 0; i < threadCount; ++i) {
+                    this->threads.emplace_back([this]() { this->Work(); });
+                }
+            }
+
+            ~ThreadPool() {
+                {
+                    std::unique_lock<std::mutex> lock(this->queueMutex);
+                    this->stopping = true;
+                }
+                this->condition.notify_all();
+
+                for (auto& thread : this->threads) {
+                    thread.join();
+                }
+            }
+
+            ThreadPool(const ThreadPool&) = delete;
+            ThreadPool& operator=(const ThreadPool&) = delete;
+
+            void Post(std::function<void()> task) {
+                {
+                    std::unique_lock<std::mutex> lock(this->queueMutex);
+                    this->tasks.push(std::move(task));
+                }
+                this->condition.notify_one();
+            }
+
+            size_t Size() const {
+                return this->threads.size();
+            }
+
+            // Runs queued tasks on the calling thread until done() holds, so a worker of this pool can wait for work
+            // that needs the pool without taking a thread away from it; call Wake() once done() may have changed
+            template <typename Done>
+            void RunUntil(Done done) {
+                while (true) {
+                    std::function<void()> task;
+                    {
+                        std::unique_lock<std::mutex> lock(this->queueMutex);
+                        this->condition.wait(lock, [this, &done]() { return done() || !this->tasks.empty(); });
+                        if (done()) {
+                            return;
+                        }
+                        task = std::move(this->tasks.front());
+                        this->tasks.pop();
+                    }
+                    task();
+                }
+            }
+
+            // Wakes every thread waiting in RunUntil to check its condition again
+            void Wake() {
+                {
+                    std::unique_lock<std::mutex> lock(this->queueMutex);
+                }
+                this->condition.notify_all();
+            }
+
+            // The pool that owns the calling thread, nullptr on threads outside any pool
+            static ThreadPool* Current() {
+                return ThreadPool::current;
+            }
+
+            // Shared pool for blocking calls (database, blob storage) awaited through Offload
+            // so they do not hold on to the listener's worker threads
+            static ThreadPool& Blocking() {
+                static ThreadPool blocking(std::max(4u, std::thread::hardware_concurrency() * 4));
+                return blocking;
+            }
+
+        private:
+            std::vector<std::thread> threads;
+            std::queue<std::function<void()>> tasks;
+            std::mutex queueMutex;
+            std::condition_variable condition;
+            bool stopping = false;
+
+            static inline thread_local ThreadPool* current = nullptr;
+
+            void Work() {
+                ThreadPool::current = this;
+
+                while (true) {
+                    std::function<void()> task;
+                    {
+                        std::unique_lock<std::mutex> lock(this->queueMutex);
+                        this->condition.wait(lock, [this]() { return this->stopping || !this->tasks.empty(); });
+                        if (this->stopping && this->tasks.empty()) {
+                            return;
+                        }
+                        task = std::move(this->tasks.front());
+                        this->tasks.pop();
+                    }
+                    task();
+                }
+            }
+        };
+    }
+}
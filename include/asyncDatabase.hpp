@@ -0,0 +1,185 @@
+#pragma once
+
+#include "CppHttp.hpp"
+#include "statements.hpp"
+#include "queryStats.hpp"
+#include <libpq-fe.h>
+#include <atomic>
+#include <chrono>
+#include <coroutine>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+// Nonblocking libpq connections for the hot reads of coroutine handlers, to the primary and to each read replica
+// A query is sent with PQsendQueryPrepared and its result read as the reactor reports the socket ready,
+// so the awaiting handler holds no thread while the database works; soci stays in use for everything else
+// Each connection runs one query at a time and callers queue for a free one in arrival order
+// Size per server comes from DB_ASYNC_POOL_SIZE; replicas from PG_REPLICA_HOSTS, as for Database
+class AsyncDatabase {
+public:
+	AsyncDatabase(const AsyncDatabase&) = delete;
+
+	static AsyncDatabase* GetInstance() {
+		static AsyncDatabase* instance = new AsyncDatabase();
+		return instance;
+	}
+
+	// co_await Execute(statement, args...) runs one of the prepared statements on the primary; arguments are sent in text format
+	template <typename... Args>
+	CppHttp::Net::Task<QueryResult> Execute(const PreparedStatement& statement, const Args&... args) {
+		return Run(*primary, statement, Bind(statement, args...));
+	}
+
+	// co_await ExecuteForRead(readToken, statement, args...) runs a read-only statement on a replica that has replayed
+	// at least up to readToken, or on the primary if there are no replicas or the chosen one is behind,
+	// the same choice Database::LeaseForRead makes
+	template <typename... Args>
+	CppHttp::Net::Task<QueryResult> ExecuteForRead(const std::string& readToken, const PreparedStatement& statement, const Args&... args) {
+		return RunForRead(readToken, statement, Bind(statement, args...));
+	}
+
+	size_t Size() const {
+		return primary->slots.size();
+	}
+
+private:
+	AsyncDatabase();
+
+	class Server;
+	class Acquire;
+
+	struct Slot {
+		Server* server = nullptr;
+		PGconn* connection = nullptr;
+	};
+
+	// Connections to one server
+	class Server {
+	public:
+		Server(std::string name, std::string connectionString, size_t size);
+
+		Server(const Server&) = delete;
+		Server& operator=(const Server&) = delete;
+
+		std::string name;
+		std::string connectionString;
+		std::vector<Slot> slots;
+
+		std::mutex mutex;
+		std::vector<Slot*> free;
+		std::deque<Acquire*> waiters;
+
+		// Last WAL position a replica was seen to have replayed
+		std::atomic<uint64_t> replayedLsn{ 0 };
+
+		std::atomic<uint64_t> queries{ 0 };
+		std::atomic<uint64_t> reconnects{ 0 };
+		std::atomic<int64_t> inUse{ 0 };
+	};
+
+	// A statement's arguments in text format, and which of them are numbers, for the slow-query log
+	struct Arguments {
+		std::vector<std::string> values;
+		std::vector<bool> numeric;
+
+		// Only built for a slow query; ids are shown, everything else only as its size
+		std::vector<QueryParameter> Described() const {
+			std::vector<QueryParameter> described;
+			for (size_t i = 0; i < values.size(); ++i) {
+				described.push_back(numeric[i] ? QueryParameter(nullptr, std::stoi(values[i])) : QueryParameter(nullptr, values[i]));
+			}
+			return described;
+		}
+	};
+
+	template <typename... Args>
+	static Arguments Bind(const PreparedStatement& statement, const Args&... args) {
+		if ((int)sizeof...(Args) != statement.parameters) {
+			throw std::invalid_argument(std::string("Wrong number of parameters for ") + statement.name);
+		}
+
+		return Arguments{ { std::string(ToParameter(args))... }, { std::is_same_v<Args, int>... } };
+	}
+
+	// Resumes with a free connection of the server, suspending until one is given back if there is none
+	class Acquire {
+	public:
+		explicit Acquire(Server& server) : server(server) {}
+
+		bool await_ready() {
+			std::lock_guard<std::mutex> lock(server.mutex);
+			return TakeFree();
+		}
+
+		bool await_suspend(std::coroutine_handle<> awaiting) {
+			std::lock_guard<std::mutex> lock(server.mutex);
+			if (TakeFree()) {
+				return false;
+			}
+
+			this->awaiting = awaiting;
+			this->resumeOn = CppHttp::Net::ThreadPool::Current() != nullptr ? CppHttp::Net::ThreadPool::Current() : &CppHttp::Net::ThreadPool::Blocking();
+			server.waiters.push_back(this);
+			return true;
+		}
+
+		Slot* await_resume() const noexcept {
+			return slot;
+		}
+
+	private:
+		friend class AsyncDatabase;
+
+		bool TakeFree() {
+			if (server.free.empty()) {
+				return false;
+			}
+			slot = server.free.back();
+			server.free.pop_back();
+			return true;
+		}
+
+		Server& server;
+		Slot* slot = nullptr;
+		std::coroutine_handle<> awaiting;
+		CppHttp::Net::ThreadPool* resumeOn = nullptr;
+	};
+
+	// Gives a connection back when the query that took it finishes, however it finishes
+	struct Lease {
+		AsyncDatabase* database;
+		Slot* slot;
+
+		~Lease() {
+			database->Release(slot);
+		}
+	};
+
+	CppHttp::Net::Task<QueryResult> Run(Server& server, const PreparedStatement& statement, Arguments arguments);
+
+	// Sends the statement and reads its result without blocking; the caller owns the result
+	CppHttp::Net::Task<PGresult*> Send(PGconn* connection, const PreparedStatement& statement, const Arguments& arguments);
+
+	CppHttp::Net::Task<QueryResult> RunForRead(std::string readToken, const PreparedStatement& statement, Arguments arguments);
+
+	// Gives the connection back once its query finished, reconnecting it first if it broke
+	void Release(Slot* slot);
+
+	// Hands a working connection to the first waiter, or returns it to the free list
+	void GiveBack(Slot* slot);
+
+	// Opens the connection, or reopens it after it broke; blocks, so it only runs at startup or on the blocking pool
+	void Connect(Slot& slot);
+
+	std::unique_ptr<Server> primary;
+	std::vector<std::unique_ptr<Server>> replicas;
+	std::atomic<size_t> nextReplica{ 0 };
+
+	std::atomic<uint64_t> replicaReads{ 0 };
+	std::atomic<uint64_t> primaryFallbacks{ 0 };
+};
@@ -0,0 +1,56 @@
+#pragma once
+
+#include "CppHttp.hpp"
+#include "tokenVerifier.hpp"
+#include <string>
+#include <tuple>
+#include <optional>
+#include <vector>
+#include <variant>
+
+using returnType = std::tuple<CppHttp::Net::ResponseType, std::string, std::optional<std::vector<std::string>>>;
+using asyncReturnType = CppHttp::Net::Task<returnType>;
+using json = nlohmann::json;
+
+struct TokenError {
+    CppHttp::Net::ResponseType type;
+    std::string message;
+};
+
+enum class Role {
+    // any role other than the ones below
+    STUDENT,
+    TEACHER,
+    ADMIN
+};
+
+// The authenticated user, attached to the request by the Authenticate middleware
+struct Principal {
+    int id = 0;
+    std::string firstName;
+    std::string lastName;
+    Role role = Role::STUDENT;
+    // sorted classroom ids from a trusted, fresh token claim; nullptr means membership is checked in the database
+    std::shared_ptr<const std::vector<int>> classrooms = nullptr;
+    // set when authenticating or authorizing this request had to query the database
+    mutable bool usedDatabase = false;
+
+    bool IsTeacher() const {
+        return role == Role::TEACHER || role == Role::ADMIN;
+    }
+};
+
+Role ParseRole(std::string role);
+
+std::variant<TokenError, TokenClaims> ValidateToken(std::string& token);
+
+// Router middleware: validates the bearer token and loads the user behind it, awaiting the database on a cache miss
+CppHttp::Net::Task<std::optional<returnType>> Authenticate(CppHttp::Net::Request& req);
+
+const Principal& GetPrincipal(CppHttp::Net::Request& req);
+
+// Membership check for the authenticated user, answered from the token's classrooms claim when it is trusted
+bool IsClassroomMember(const Principal& principal, int classroomId);
+
+// Router response observer counting how many requests were authorized without touching the database
+void RecordAuthStatistics(CppHttp::Net::Request& req, const returnType& response);
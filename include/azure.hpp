@@ -11,27 +11,19 @@ class Blobs {
 private:
 	Blobs() = default;
 
-	static Blobs* azureInstance;
 	Azure::Storage::Blobs::BlobServiceClient serviceClient = Azure::Storage::Blobs::BlobServiceClient::CreateFromConnectionString(std::getenv("BLOBS_CONN"));
 
 public:
 	Blobs(const Blobs&) = delete;
 
 	static Blobs* GetInstance() {
-		if (azureInstance == nullptr) {
-			azureInstance = new Blobs();
-		}
-		return azureInstance;
+		static Blobs* instance = new Blobs();
+		return instance;
 	}
 
 	Azure::Storage::Blobs::BlobServiceClient* GetClient() {
 		return &serviceClient;
 	}
 
-	void Close() {
-		delete azureInstance;
-		azureInstance = nullptr;
-	}
-
 	static std::mutex azureMutex;
 };
\ No newline at end of file
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <cstdlib>
+#include <string>
+
+// Numeric setting from the environment, or fallback when it is unset or not a number
+inline long long GetEnvNumber(const char* name, long long fallback) {
+	const char* value = std::getenv(name);
+
+	if (value == nullptr || *value == '\0') {
+		return fallback;
+	}
+
+	char* end = nullptr;
+	long long number = std::strtoll(value, &end, 10);
+
+	return *end == '\0' ? number : fallback;
+}
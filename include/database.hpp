@@ -1,44 +1,223 @@
 #pragma once
 
 #include <soci/soci.h>
+#include <soci/connection-pool.h>
 #include <soci/postgresql/soci-postgresql.h>
+#include "statements.hpp"
+#include "queryStats.hpp"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <cstdlib>
+#include <initializer_list>
+#include <memory>
 #include <string>
+#include <utility>
 #include <mutex>
+#include <optional>
 #include <iostream>
+#include <vector>
 
 using namespace soci;
 
+// Pools of PostgreSQL sessions shared by all handler threads: one for the primary and one per read replica
+// Each query block leases its own session, so statements from different requests run concurrently
+// Size and lease timeout come from DB_POOL_SIZE and DB_LEASE_TIMEOUT_MS; replicas from PG_REPLICA_HOSTS (host[:port],...)
 class Database {
-private:
-	Database() {
-		dbMutex.lock();
-		sql.open(postgresql, "dbname=" + (std::string)std::getenv("PG_DB") + " user=" + (std::string)std::getenv("PG_USER") + " password=" + (std::string)std::getenv("PG_PASS") + " host=" + (std::string)std::getenv("PG_HOST") + " port=" + (std::string)std::getenv("PG_PORT") + " sslmode=require");	
-		dbMutex.unlock();
-	}
+public:
+	class Connection;
 
-	static Database* databaseInstance;
-	soci::session sql;
+	// Sessions to one server
+	class Pool {
+	public:
+		Pool(std::string name, const std::string& connectionString, size_t size, std::chrono::milliseconds leaseTimeout);
+
+		Pool(const Pool&) = delete;
+		Pool& operator=(const Pool&) = delete;
+
+		// Waits up to the lease timeout for a free session; throws if none frees up or a broken one cannot be reconnected
+		Connection Lease();
+
+		size_t Size() const {
+			return size;
+		}
+
+		// Last WAL position a replica was seen to have replayed
+		std::atomic<uint64_t> replayedLsn{ 0 };
+
+	private:
+		friend class Connection;
+
+		void GiveBack(size_t position);
+
+		std::string name;
+		size_t size;
+		std::chrono::milliseconds leaseTimeout;
+		soci::connection_pool pool;
+
+		std::atomic<uint64_t> leases{ 0 };
+		std::atomic<uint64_t> leaseWaitNanos{ 0 };
+		std::atomic<uint64_t> leaseTimeouts{ 0 };
+		std::atomic<uint64_t> reconnects{ 0 };
+		std::atomic<int64_t> inUse{ 0 };
+	};
+
+	// A pooled session, given back to its pool when this object goes out of scope
+	class Connection {
+	public:
+		Connection(Pool* pool, size_t position, std::chrono::nanoseconds waited = {}) : pool(pool), position(position), waited(waited) {}
+
+		Connection(Connection&& other) noexcept : pool(other.pool), position(other.position), waited(other.waited) {
+			other.pool = nullptr;
+		}
+
+		Connection(const Connection&) = delete;
+		Connection& operator=(const Connection&) = delete;
+		Connection& operator=(Connection&&) = delete;
+
+		~Connection() {
+			if (pool != nullptr) {
+				pool->GiveBack(position);
+			}
+		}
+
+		soci::session& operator*() {
+			return pool->pool.at(position);
+		}
+
+		soci::session* operator->() {
+			return &pool->pool.at(position);
+		}
+
+		// Runs query, which returns the number of rows it produced, timed under label in the db_query_* metrics
+		// parameters are what the slow-query log shows, with sensitive values redacted; they are only copied for a slow query
+		template <typename Query>
+		void Timed(std::string_view label, std::initializer_list<QueryParameter> parameters, Query query) {
+			Timed(label, [parameters]() { return std::vector<QueryParameter>(parameters); }, query);
+		}
+
+		// As above, with describe() building the parameters for the slow-query log only when a query is slow
+		template <typename Describe, typename Query>
+		void Timed(std::string_view label, Describe describe, Query query) {
+			StatementStats& stats = QueryStats::GetInstance()->For(label);
+			std::chrono::nanoseconds waited = std::exchange(this->waited, {});
+
+			auto start = std::chrono::steady_clock::now();
+			uint64_t rows = 0;
+
+			try {
+				rows = (uint64_t)query();
+			}
+			catch (...) {
+				QueryStats::GetInstance()->Record(stats, std::chrono::steady_clock::now() - start, waited, 0, describe);
+				throw;
+			}
+
+			QueryStats::GetInstance()->Record(stats, std::chrono::steady_clock::now() - start, waited, rows, describe);
+		}
+
+		// Runs one of the statements prepared on every connection; arguments are sent in text format
+		template <typename... Args>
+		QueryResult Execute(const PreparedStatement& statement, const Args&... args) {
+			if ((int)sizeof...(Args) != statement.parameters) {
+				throw std::invalid_argument(std::string("Wrong number of parameters for ") + statement.name);
+			}
+
+			std::array<std::string, sizeof...(Args)> values = { ToParameter(args)... };
+			std::array<const char*, sizeof...(Args)> pointers;
+
+			for (size_t i = 0; i < values.size(); ++i) {
+				pointers[i] = values[i].c_str();
+			}
+
+			auto describe = [&]() {
+				std::vector<QueryParameter> described;
+				[[maybe_unused]] size_t position = 0;
+				(described.push_back(QueryParameter::Positional(args, values[position++])), ...);
+				return described;
+			};
+
+			std::optional<QueryResult> result;
+			Timed(statement.name, describe, [&]() {
+				result.emplace(PQexecPrepared(Native(**this), statement.name, statement.parameters, pointers.data(), nullptr, nullptr, 0));
+				return result->Rows();
+			});
+
+			return std::move(*result);
+		}
+
+	private:
+		Pool* pool;
+		size_t position;
+		// time spent waiting for this session, charged to the first statement timed on it
+		std::chrono::nanoseconds waited;
+	};
+
+	// libpq connection string for a server, with the PG_DB, PG_USER and PG_PASS credentials
+	static std::string ConnectionString(const std::string& host, const std::string& port);
+
+	// Connection strings of the read replicas in PG_REPLICA_HOSTS (host[:port],...), PG_PORT where no port is given
+	static std::vector<std::string> ReplicaConnectionStrings();
+
+	// "16/B374D848" -> 0x16B374D848; 0 if it is not an LSN
+	static uint64_t ParseLsn(const std::string& lsn);
+
+	static PGconn* Native(soci::session& session) {
+		return static_cast<soci::postgresql_session_backend*>(session.get_backend())->conn_;
+	}
 
-public:
 	Database(const Database&) = delete;
 
 	static Database* GetInstance() {
-		if (databaseInstance == nullptr) {
-			databaseInstance = new Database();
-		}
-		return databaseInstance;
+		static Database* instance = new Database();
+		return instance;
 	}
 
-	soci::session* GetSession() {
-		return &sql;
+	// Session on the primary, for writes and anything that must see them
+	Connection Lease() {
+		return primary->Lease();
 	}
 
+	// Session for a read-only handler: a replica that has replayed at least up to readToken,
+	// or the primary if there are no replicas or the chosen one is behind
+	Connection LeaseForRead(const std::string& readToken);
+
+	// Token for the client's next read after a write, so it sees the write even on a lagging replica
+	// Empty when there are no replicas to lag; concurrent writers share one query for it
+	std::string ReadToken();
+
+	bool HasReplicas() const {
+		return !replicas.empty();
+	}
+
+	size_t Size() const {
+		return primary->Size();
+	}
+
+	// Closes every session; only for shutdown, nothing may lease a connection afterwards
 	void Close() {
-		sql.close();
-		delete databaseInstance;
-		databaseInstance = nullptr;
+		primary.reset();
+		replicas.clear();
 	}
 
-	static std::mutex dbMutex;
-};
\ No newline at end of file
+private:
+	Database();
+
+	// Prepares every statement in Statements::All; needed again after a reconnect
+	static void PrepareStatements(soci::session& session);
+
+	std::unique_ptr<Pool> primary;
+	std::vector<std::unique_ptr<Pool>> replicas;
+	std::atomic<size_t> nextReplica{ 0 };
+
+	std::atomic<uint64_t> replicaReads{ 0 };
+	std::atomic<uint64_t> primaryFallbacks{ 0 };
+
+	// ReadToken's shared query: at most one runs at a time, the ones started and finished are counted
+	std::mutex tokenMutex;
+	std::condition_variable tokenFetched;
+	bool tokenFetching = false;
+	uint64_t tokenFetchesStarted = 0;
+	uint64_t tokenFetchesFinished = 0;
+	std::string latestToken;
+};
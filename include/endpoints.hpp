@@ -1,8 +1,13 @@
 #pragma once
 
 #include "CppHttp.hpp"
+#include "auth.hpp"
 #include "database.hpp"
-#include "jwt-cpp/traits/nlohmann-json/traits.h"
+#include "asyncDatabase.hpp"
+#include "membership.hpp"
+#include "unitOfWork.hpp"
+#include "config.hpp"
+#include "jwt-cpp/base.h"
 #include <iostream>
 #include <iomanip>
 #include <string>
@@ -14,19 +19,18 @@
 #include <cstdlib>
 #include <variant>
 #include <cuchar>
+#include <charconv>
 #include "formParser.hpp"
+#include "groupIndex.hpp"
+#include "rowMapping.hpp"
+#include "timestamp.hpp"
 #include "../include/hash.hpp"
 #include "../include/azure.hpp"
 
-using returnType = std::tuple<CppHttp::Net::ResponseType, std::string, std::optional<std::vector<std::string>>>;
-using json = nlohmann::json;
-
 #pragma region Data Structures
 struct User {
 	int id;
 	std::string email;
-	std::string password;
-	std::string salt;
 	std::string firstName;
 	std::string lastName;
     std::string role;
@@ -42,7 +46,7 @@ struct Assignment {
     int id;
     std::string title;
     std::string description;
-    std::tm dueDate;
+    Timestamp dueDate;
     int classroomId;
 };
 
@@ -51,7 +55,7 @@ struct Submission {
     int assignmentId;
     int userId;
     std::string text;
-    std::tm submittedAt;
+    Timestamp submittedAt;
 };
 
 struct FileSubmission {
@@ -72,6 +76,8 @@ struct UserSubmissionJoin {
     std::string lastName;
     std::string email;
     int userId;
+    std::string text;
+    Timestamp submittedAt;
 };
 
 struct Grade {
@@ -82,9 +88,89 @@ struct Grade {
     std::string feedback;
 };
 
-struct TokenError {
-    CppHttp::Net::ResponseType type;
-    std::string message;
+// Column order of every struct read from the database; queries select ColumnList<T>() so rows decode by position
+template <>
+struct RowMapping<User> {
+    static constexpr std::tuple columns{
+        Column{ "id", &User::id },
+        Column{ "email", &User::email },
+        Column{ "first_name", &User::firstName },
+        Column{ "last_name", &User::lastName },
+        Column{ "role", &User::role }
+    };
+};
+
+template <>
+struct RowMapping<Classroom> {
+    static constexpr std::tuple columns{
+        Column{ "id", &Classroom::id },
+        Column{ "name", &Classroom::name },
+        Column{ "owner_id", &Classroom::ownerId }
+    };
+};
+
+template <>
+struct RowMapping<Assignment> {
+    static constexpr std::tuple columns{
+        Column{ "id", &Assignment::id },
+        Column{ "title", &Assignment::title },
+        Column{ "description", &Assignment::description },
+        Column{ "due_date", &Assignment::dueDate },
+        Column{ "classroom_id", &Assignment::classroomId }
+    };
+};
+
+template <>
+struct RowMapping<FileAssignment> {
+    static constexpr std::tuple columns{
+        Column{ "id", &FileAssignment::id },
+        Column{ "assignment_id", &FileAssignment::assignmentId },
+        Column{ "link", &FileAssignment::link }
+    };
+};
+
+template <>
+struct RowMapping<Submission> {
+    static constexpr std::tuple columns{
+        Column{ "id", &Submission::id },
+        Column{ "assignment_id", &Submission::assignmentId },
+        Column{ "user_id", &Submission::userId },
+        Column{ "text", &Submission::text },
+        Column{ "submitted_at", &Submission::submittedAt }
+    };
+};
+
+template <>
+struct RowMapping<FileSubmission> {
+    static constexpr std::tuple columns{
+        Column{ "id", &FileSubmission::id },
+        Column{ "submission_id", &FileSubmission::submissionId },
+        Column{ "link", &FileSubmission::link }
+    };
+};
+
+template <>
+struct RowMapping<UserSubmissionJoin> {
+    static constexpr std::tuple columns{
+        Column{ "submissions.id", &UserSubmissionJoin::id },
+        Column{ "users.first_name", &UserSubmissionJoin::firstName },
+        Column{ "users.last_name", &UserSubmissionJoin::lastName },
+        Column{ "users.email", &UserSubmissionJoin::email },
+        Column{ "submissions.user_id", &UserSubmissionJoin::userId },
+        Column{ "submissions.text", &UserSubmissionJoin::text },
+        Column{ "submissions.submitted_at", &UserSubmissionJoin::submittedAt }
+    };
+};
+
+template <>
+struct RowMapping<Grade> {
+    static constexpr std::tuple columns{
+        Column{ "id", &Grade::id },
+        Column{ "assignment_id", &Grade::assignmentId },
+        Column{ "user_id", &Grade::userId },
+        Column{ "grade", &Grade::grade },
+        Column{ "feedback", &Grade::feedback }
+    };
 };
 
 namespace soci
@@ -94,26 +180,14 @@ namespace soci
     {
         typedef values base_type;
 
-        static void from_base(values const& v, indicator /* ind */, User& u)
+        static void from_base(values const& v, indicator /* ind */, User& row)
         {
-            u.id = v.get<int>("id", 0);
-            u.email = v.get<std::string>("email");
-            u.password = v.get<std::string>("password");
-            u.salt = v.get<std::string>("salt");
-            u.firstName = v.get<std::string>("first_name");
-            u.lastName = v.get<std::string>("last_name");
-            u.role = v.get<std::string>("role");
+            DecodeRow(v, row);
         }
 
-        static void to_base(const User& u, values& v, indicator& ind)
+        static void to_base(const User& row, values& v, indicator& ind)
         {
-            v.set("id", u.id);
-            v.set("email", u.email);
-            v.set("password", u.password);
-            v.set("salt", u.salt);
-            v.set("first_name", u.firstName);
-            v.set("last_name", u.lastName);
-            v.set("role", u.role);
+            EncodeRow(row, v);
             ind = i_ok;
         }
     };
@@ -121,45 +195,33 @@ namespace soci
     template<>
     struct type_conversion<Classroom>
     {
-		typedef values base_type;
+        typedef values base_type;
 
-        static void from_base(values const& v, indicator /* ind */, Classroom& c)
+        static void from_base(values const& v, indicator /* ind */, Classroom& row)
         {
-			c.id = v.get<int>("id", 0);
-			c.name = v.get<std::string>("name");
-			c.ownerId = v.get<int>("owner_id");
-		}
+            DecodeRow(v, row);
+        }
 
-        static void to_base(const Classroom& c, values& v, indicator& ind)
+        static void to_base(const Classroom& row, values& v, indicator& ind)
         {
-			v.set("id", c.id);
-			v.set("name", c.name);
-			v.set("owner_id", c.ownerId);
-			ind = i_ok;
-		}
-	};
+            EncodeRow(row, v);
+            ind = i_ok;
+        }
+    };
 
     template<>
     struct type_conversion<Assignment>
     {
         typedef values base_type;
 
-        static void from_base(values const& v, indicator /* ind */, Assignment& a)
+        static void from_base(values const& v, indicator /* ind */, Assignment& row)
         {
-            a.id = v.get<int>("id", 0);
-            a.title = v.get<std::string>("title");
-            a.description = v.get<std::string>("description");
-            a.dueDate = v.get<std::tm>("due_date");
-            a.classroomId = v.get<int>("classroom_id");
+            DecodeRow(v, row);
         }
 
-        static void to_base(const Assignment& a, values& v, indicator& ind)
+        static void to_base(const Assignment& row, values& v, indicator& ind)
         {
-            v.set("id", a.id);
-            v.set("title", a.title);
-            v.set("description", a.description);
-            v.set("due_date", a.dueDate);
-            v.set("classroom_id", a.classroomId);
+            EncodeRow(row, v);
             ind = i_ok;
         }
     };
@@ -169,18 +231,14 @@ namespace soci
     {
         typedef values base_type;
 
-        static void from_base(values const& v, indicator /* ind */, FileAssignment& fa)
+        static void from_base(values const& v, indicator /* ind */, FileAssignment& row)
         {
-            fa.id = v.get<int>("id", 0);
-            fa.assignmentId = v.get<int>("assignment_id");
-            fa.link = v.get<std::string>("link");
+            DecodeRow(v, row);
         }
 
-        static void to_base(const FileAssignment& fa, values& v, indicator& ind)
+        static void to_base(const FileAssignment& row, values& v, indicator& ind)
         {
-            v.set("id", fa.id);
-            v.set("assignment_id", fa.assignmentId);
-            v.set("link", fa.link);
+            EncodeRow(row, v);
             ind = i_ok;
         }
     };
@@ -190,22 +248,14 @@ namespace soci
     {
         typedef values base_type;
 
-        static void from_base(values const& v, indicator /* ind */, Submission& s)
+        static void from_base(values const& v, indicator /* ind */, Submission& row)
         {
-            s.id = v.get<int>("id", 0);
-            s.assignmentId = v.get<int>("assignment_id");
-            s.userId = v.get<int>("user_id");
-            s.text = v.get<std::string>("text");
-            s.submittedAt = v.get<std::tm>("submitted_at");
+            DecodeRow(v, row);
         }
 
-        static void to_base(const Submission& s, values& v, indicator& ind)
+        static void to_base(const Submission& row, values& v, indicator& ind)
         {
-            v.set("id", s.id);
-            v.set("assignment_id", s.assignmentId);
-            v.set("user_id", s.userId);
-            v.set("text", s.text);
-            v.set("submitted_at", s.submittedAt);
+            EncodeRow(row, v);
             ind = i_ok;
         }
     };
@@ -215,18 +265,14 @@ namespace soci
     {
         typedef values base_type;
 
-        static void from_base(values const& v, indicator /* ind */, FileSubmission& fs)
+        static void from_base(values const& v, indicator /* ind */, FileSubmission& row)
         {
-            fs.id = v.get<int>("id", 0);
-            fs.submissionId = v.get<int>("submission_id");
-            fs.link = v.get<std::string>("link");
+            DecodeRow(v, row);
         }
 
-        static void to_base(const FileSubmission& fs, values& v, indicator& ind)
+        static void to_base(const FileSubmission& row, values& v, indicator& ind)
         {
-            v.set("id", fs.id);
-            v.set("submission_id", fs.submissionId);
-            v.set("link", fs.link);
+            EncodeRow(row, v);
             ind = i_ok;
         }
     };
@@ -236,22 +282,14 @@ namespace soci
     {
         typedef values base_type;
 
-        static void from_base(values const& v, indicator /* ind */, UserSubmissionJoin& usj)
+        static void from_base(values const& v, indicator /* ind */, UserSubmissionJoin& row)
         {
-            usj.id = v.get<int>("id", 0);
-            usj.firstName = v.get<std::string>("first_name");
-            usj.lastName = v.get<std::string>("last_name");
-            usj.email = v.get<std::string>("email");
-            usj.userId = v.get<int>("user_id");
+            DecodeRow(v, row);
         }
 
-        static void to_base(const UserSubmissionJoin& usj, values& v, indicator& ind)
+        static void to_base(const UserSubmissionJoin& row, values& v, indicator& ind)
         {
-            v.set("id", usj.id);
-            v.set("first_name", usj.firstName);
-            v.set("last_name", usj.lastName);
-            v.set("email", usj.email);
-            v.set("user_id", usj.userId);
+            EncodeRow(row, v);
             ind = i_ok;
         }
     };
@@ -261,60 +299,75 @@ namespace soci
     {
         typedef values base_type;
 
-        static void from_base(values const& v, indicator /* ind */, Grade& g)
+        static void from_base(values const& v, indicator /* ind */, Grade& row)
         {
-            g.id = v.get<int>("id", 0);
-            g.assignmentId = v.get<int>("assignment_id");
-            g.userId = v.get<int>("user_id");
-            g.grade = v.get<double>("grade");
-            g.feedback = v.get<std::string>("feedback");
+            DecodeRow(v, row);
         }
 
-        static void to_base(const Grade& g, values& v, indicator& ind)
+        static void to_base(const Grade& row, values& v, indicator& ind)
         {
-            v.set("id", g.id);
-            v.set("assignment_id", g.assignmentId);
-            v.set("user_id", g.userId);
-            v.set("grade", g.grade);
-            v.set("feedback", g.feedback);
+            EncodeRow(row, v);
             ind = i_ok;
         }
     };
 }
 #pragma endregion
 
-std::variant<TokenError, json> ValidateToken(std::string& token);
+// Numeric id from a path parameter, nullopt if it is not a number
+std::optional<int> ParseId(const std::string& value);
+
+// Due date from a request body, "DD-MM-YYYY HH:MM:SS" or ISO-8601; nullopt if it is neither
+std::optional<Timestamp> ParseDueDate(const std::string& value);
+
+// X-Read-Token header for a write's response; the client sends it back on its next GET so a replica that has not replayed the write yet is skipped
+std::optional<std::vector<std::string>> ReadTokenHeader();
+
+// One page of a listing, from ?limit= and the opaque ?after= cursor of the previous page
+// Rows are returned in id order starting after the given id, so each page is an index range scan
+struct Page {
+    int limit;
+    int after;
+};
+
+// Page the request asks for; nullopt if limit or after is malformed
+std::optional<Page> ParsePage(CppHttp::Net::Request& req);
+
+// X-Next-Cursor header pointing after lastId, for the client to pass back as ?after=
+std::optional<std::vector<std::string>> NextCursorHeader(int lastId);
 
 #pragma region Assignment Functions
 
-returnType CreateAssignment(CppHttp::Net::Request req);
+asyncReturnType CreateAssignment(CppHttp::Net::Request& req);
 
-returnType GetAllAssignments(CppHttp::Net::Request req);
+returnType GetAllAssignments(CppHttp::Net::Request& req);
 
-returnType GetAssignment(CppHttp::Net::Request req);
+asyncReturnType GetAssignment(CppHttp::Net::Request& req);
 
-returnType EditAssignment(CppHttp::Net::Request req);
+asyncReturnType EditAssignment(CppHttp::Net::Request& req);
 
-returnType DeleteAssignment(CppHttp::Net::Request req);
+returnType DeleteAssignment(CppHttp::Net::Request& req);
 
 #pragma endregion
 
 #pragma region Submission Functions
 
-returnType SubmitAssignment(CppHttp::Net::Request req);
+asyncReturnType SubmitAssignment(CppHttp::Net::Request& req);
 
-returnType GetAllSubmissions(CppHttp::Net::Request req);
+returnType GetAllSubmissions(CppHttp::Net::Request& req);
 
-returnType DeleteSubmission(CppHttp::Net::Request req);
+returnType DeleteSubmission(CppHttp::Net::Request& req);
 
 #pragma endregion
 
 #pragma region Grade Functions
 
-returnType GradeAssignment(CppHttp::Net::Request req);
+returnType GradeAssignment(CppHttp::Net::Request& req);
+
+// Grades many users at once from a JSON array of { user_id, grade, feedback }, replacing existing grades
+returnType BulkGradeAssignment(CppHttp::Net::Request& req);
 
-returnType RemoveGrade(CppHttp::Net::Request req);
+returnType RemoveGrade(CppHttp::Net::Request& req);
 
-returnType EditGrade(CppHttp::Net::Request req);
+returnType EditGrade(CppHttp::Net::Request& req);
 
 #pragma endregion
\ No newline at end of file
@@ -11,7 +11,7 @@ private:
 
 	std::unordered_map<std::u8string, std::u8string> fields;
 public:
-	FormParser(CppHttp::Net::Request req);
+	FormParser(CppHttp::Net::Request& req);
 
 	std::vector<std::unordered_map<std::u8string, std::u8string>> Parse();
 };
\ No newline at end of file
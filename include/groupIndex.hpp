@@ -0,0 +1,57 @@
+#pragma once
+
+#include <span>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Rows of a fetched rowset grouped by a key, so listing handlers join rowsets in linear time instead of
+// scanning one for every row of the other
+// Built in two passes into one flat array of pointers; rows with the same key keep their original order
+// The rows must outlive the index
+template <typename Row, typename Key = int>
+class GroupIndex {
+public:
+	template <typename KeyOf>
+	GroupIndex(const std::vector<Row>& rows, KeyOf keyOf) : grouped(rows.size()) {
+		ranges.reserve(rows.size());
+
+		// count the rows of each key, then turn the counts into the start of each group
+		for (const Row& row : rows) {
+			++ranges[keyOf(row)].second;
+		}
+
+		size_t offset = 0;
+		for (auto& [key, range] : ranges) {
+			size_t count = range.second;
+			range = { offset, offset };
+			offset += count;
+		}
+
+		// range.second now advances to the end of the group as its rows are placed
+		for (const Row& row : rows) {
+			auto& range = ranges[keyOf(row)];
+			grouped[range.second++] = &row;
+		}
+	}
+
+	// First row with the key, nullptr if there is none
+	const Row* First(const Key& key) const {
+		auto found = ranges.find(key);
+		return found == ranges.end() ? nullptr : grouped[found->second.first];
+	}
+
+	// Every row with the key, in rowset order
+	std::span<const Row* const> All(const Key& key) const {
+		auto found = ranges.find(key);
+		if (found == ranges.end()) {
+			return {};
+		}
+
+		return std::span<const Row* const>(grouped.data() + found->second.first, found->second.second - found->second.first);
+	}
+
+private:
+	std::vector<const Row*> grouped;
+	std::unordered_map<Key, std::pair<size_t, size_t>> ranges;
+};
@@ -0,0 +1,141 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+// Bounded LRU cache split into independently locked shards so lookups from different worker threads rarely contend
+// Every entry carries its own expiry; expired entries are dropped when they are next looked up or pushed out by newer ones
+template <typename Key, typename Value, typename Hash = std::hash<Key>>
+class ShardedLruCache {
+public:
+	using Clock = std::chrono::steady_clock;
+
+	explicit ShardedLruCache(size_t capacity, size_t shardCount = 16) : shards(shardCount == 0 ? 1 : shardCount) {
+		size_t perShard = (capacity + this->shards.size() - 1) / this->shards.size();
+
+		for (auto& shard : this->shards) {
+			shard.capacity = perShard == 0 ? 1 : perShard;
+		}
+	}
+
+	ShardedLruCache(const ShardedLruCache&) = delete;
+	ShardedLruCache& operator=(const ShardedLruCache&) = delete;
+
+	std::optional<Value> Get(const Key& key) {
+		Shard& shard = this->ShardFor(key);
+		std::lock_guard<std::mutex> lock(shard.mutex);
+
+		auto found = shard.index.find(key);
+		if (found == shard.index.end()) {
+			this->misses.fetch_add(1, std::memory_order_relaxed);
+			return std::nullopt;
+		}
+
+		if (Clock::now() >= found->second->expiresAt) {
+			shard.order.erase(found->second);
+			shard.index.erase(found);
+			this->misses.fetch_add(1, std::memory_order_relaxed);
+			return std::nullopt;
+		}
+
+		// move to the front so the least recently used entry is always at the back
+		shard.order.splice(shard.order.begin(), shard.order, found->second);
+		this->hits.fetch_add(1, std::memory_order_relaxed);
+
+		return found->second->value;
+	}
+
+	void Put(const Key& key, Value value, Clock::time_point expiresAt) {
+		Shard& shard = this->ShardFor(key);
+		std::lock_guard<std::mutex> lock(shard.mutex);
+
+		auto found = shard.index.find(key);
+		if (found != shard.index.end()) {
+			found->second->value = std::move(value);
+			found->second->expiresAt = expiresAt;
+			shard.order.splice(shard.order.begin(), shard.order, found->second);
+			return;
+		}
+
+		if (shard.index.size() >= shard.capacity) {
+			shard.index.erase(shard.order.back().key);
+			shard.order.pop_back();
+		}
+
+		shard.order.push_front(Node{ key, std::move(value), expiresAt });
+		shard.index.emplace(key, shard.order.begin());
+	}
+
+	void Put(const Key& key, Value value, Clock::duration ttl) {
+		this->Put(key, std::move(value), Clock::now() + ttl);
+	}
+
+	void Erase(const Key& key) {
+		Shard& shard = this->ShardFor(key);
+		std::lock_guard<std::mutex> lock(shard.mutex);
+
+		auto found = shard.index.find(key);
+		if (found != shard.index.end()) {
+			shard.order.erase(found->second);
+			shard.index.erase(found);
+		}
+	}
+
+	void Clear() {
+		for (auto& shard : this->shards) {
+			std::lock_guard<std::mutex> lock(shard.mutex);
+			shard.index.clear();
+			shard.order.clear();
+		}
+	}
+
+	size_t Size() {
+		size_t size = 0;
+		for (auto& shard : this->shards) {
+			std::lock_guard<std::mutex> lock(shard.mutex);
+			size += shard.index.size();
+		}
+		return size;
+	}
+
+	uint64_t Hits() const {
+		return this->hits.load(std::memory_order_relaxed);
+	}
+
+	uint64_t Misses() const {
+		return this->misses.load(std::memory_order_relaxed);
+	}
+
+private:
+	struct Node {
+		Key key;
+		Value value;
+		Clock::time_point expiresAt;
+	};
+
+	struct Shard {
+		std::mutex mutex;
+		std::list<Node> order;
+		std::unordered_map<Key, typename std::list<Node>::iterator, Hash> index;
+		size_t capacity = 1;
+	};
+
+	Shard& ShardFor(const Key& key) {
+		// std::hash is the identity for integers, so mix the bits before picking a shard;
+		// the high bits are used so the shard choice does not line up with the bucket choice inside the shard
+		uint64_t hash = (uint64_t)Hash{}(key) * 0x9E3779B97F4A7C15ull;
+		return this->shards[(hash >> 32) % this->shards.size()];
+	}
+
+	std::vector<Shard> shards;
+	std::atomic<uint64_t> hits{ 0 };
+	std::atomic<uint64_t> misses{ 0 };
+};
@@ -0,0 +1,57 @@
+#pragma once
+
+#include "lruCache.hpp"
+#include <chrono>
+#include <cstdint>
+#include <optional>
+
+// Permission lookups that nearly every endpoint makes, answered from memory when possible
+// Classroom membership is cached per (classroom, user); members are kept for MEMBERSHIP_TTL seconds and
+// non-members for the shorter MEMBERSHIP_NEGATIVE_TTL so a newly added member is not locked out for long
+// Memberships are written by the classroom service, never here, so cached ones change only by expiring
+// Assignments never move between classrooms and submissions never move between assignments,
+// so those reverse indexes only expire to bound memory
+class Membership {
+public:
+	Membership(const Membership&) = delete;
+
+	static Membership* GetInstance() {
+		static Membership* instance = new Membership();
+		return instance;
+	}
+
+	// queried, if given, is set when the answer had to come from the database
+	bool IsMember(int classroomId, int userId, bool* queried = nullptr);
+
+	// Classroom the assignment belongs to, nullopt if there is no such assignment
+	std::optional<int> ClassroomOfAssignment(int assignmentId);
+
+	// Classroom of the submission's assignment, nullopt if there is no such submission
+	std::optional<int> ClassroomOfSubmission(int submissionId);
+
+	// Record relationships already loaded by a handler so later lookups skip the database
+	void RememberAssignment(int assignmentId, int classroomId);
+	void RememberSubmission(int submissionId, int assignmentId);
+
+	// Fills the cache with the classrooms of the newest assignments and their members, before traffic arrives
+	// Returns the number of memberships loaded
+	size_t Preload(int assignments);
+
+	void ForgetAssignment(int assignmentId);
+	void ForgetSubmission(int submissionId);
+
+private:
+	Membership();
+
+	static uint64_t Key(int classroomId, int userId) {
+		return ((uint64_t)(uint32_t)classroomId << 32) | (uint32_t)userId;
+	}
+
+	ShardedLruCache<uint64_t, bool> members;
+	ShardedLruCache<int, int> assignmentClassrooms;
+	ShardedLruCache<int, int> submissionAssignments;
+
+	std::chrono::seconds memberTtl;
+	std::chrono::seconds nonMemberTtl;
+	std::chrono::seconds indexTtl;
+};
@@ -0,0 +1,47 @@
+#pragma once
+
+#include "CppHttp.hpp"
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <tuple>
+#include <vector>
+
+// Process-wide registry of metrics, served in the Prometheus text format on GET /metrics
+// Modules keep their own atomic counters and register a callback that reads them when the endpoint is scraped
+class Metrics {
+public:
+	enum class Type {
+		COUNTER,
+		GAUGE,
+		// one series of a histogram: name_bucket{...,le="..."}, name_sum or name_count
+		HISTOGRAM
+	};
+
+	Metrics(const Metrics&) = delete;
+
+	static Metrics* GetInstance() {
+		static Metrics* instance = new Metrics();
+		return instance;
+	}
+
+	void Register(std::string name, Type type, std::string help, std::function<double()> read);
+
+	std::string Render();
+
+private:
+	Metrics() = default;
+
+	struct Metric {
+		std::string name;
+		Type type;
+		std::string help;
+		std::function<double()> read;
+	};
+
+	std::mutex mutex;
+	std::vector<Metric> metrics;
+};
+
+std::tuple<CppHttp::Net::ResponseType, std::string, std::optional<std::vector<std::string>>> GetMetrics(CppHttp::Net::Request& req);
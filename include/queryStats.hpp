@@ -0,0 +1,121 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+// Histogram with fixed bucket bounds, updated with relaxed atomics so recording never takes a lock
+class Histogram {
+public:
+	explicit Histogram(std::span<const double> bounds) : bounds(bounds), buckets(bounds.size() + 1) {}
+
+	void Observe(double value);
+
+	// Observations less than or equal to bounds[bucket]; bucket == bounds.size() is +Inf
+	uint64_t Cumulative(size_t bucket) const;
+
+	double Sum() const {
+		return sum.load(std::memory_order_relaxed);
+	}
+
+	uint64_t Count() const {
+		return count.load(std::memory_order_relaxed);
+	}
+
+	std::span<const double> Bounds() const {
+		return bounds;
+	}
+
+private:
+	std::span<const double> bounds;
+	std::vector<std::atomic<uint64_t>> buckets;
+	std::atomic<double> sum{ 0 };
+	std::atomic<uint64_t> count{ 0 };
+};
+
+// Timings of one statement label, exported as db_query_* histograms
+struct StatementStats {
+	explicit StatementStats(std::string label);
+
+	std::string label;
+	Histogram seconds;
+	Histogram rows;
+	Histogram waitSeconds;
+};
+
+// A bound value shown in the slow-query log
+// Strings are only shown for parameters named in the allow list in queryStats.cpp; positional ones never are
+struct QueryParameter {
+	QueryParameter(const char* name, int value) : name(name), number(value) {}
+	QueryParameter(const char* name, double value) : name(name), number(value) {}
+	QueryParameter(const char* name, const std::string& value) : name(name), text(&value) {}
+
+	// $n argument of a prepared statement given both as passed and as sent; ids are shown, everything else only as its size
+	template <typename T>
+	static QueryParameter Positional(const T& value, const std::string& text) {
+		if constexpr (std::is_same_v<T, int>) {
+			return QueryParameter(nullptr, value);
+		}
+		else {
+			return QueryParameter(nullptr, text);
+		}
+	}
+
+	const char* name;
+	double number = 0;
+	const std::string* text = nullptr;
+};
+
+// Per-label statement statistics and the slow-query log
+// Labels live in a fixed open-addressing table that is read and extended with atomics only,
+// so looking one up on every query never blocks on another thread
+class QueryStats {
+public:
+	QueryStats(const QueryStats&) = delete;
+
+	static QueryStats* GetInstance() {
+		static QueryStats* instance = new QueryStats();
+		return instance;
+	}
+
+	// Stats for a label, registered with the metrics endpoint the first time it is seen
+	StatementStats& For(std::string_view label);
+
+	// Records a finished statement; describe() is only called for a statement that goes to the slow-query log,
+	// so the parameters are not gathered for the others
+	template <typename Describe>
+	void Record(StatementStats& stats, std::chrono::nanoseconds elapsed, std::chrono::nanoseconds waited, uint64_t rows, Describe describe) {
+		if (Observe(stats, elapsed, waited, rows)) {
+			LogSlow(stats, elapsed, waited, rows, describe());
+		}
+	}
+
+	// "; name=value, $2=value, ...", for the slow-query log, with string values redacted unless the parameter is on the allow list
+	static std::string DescribeParameters(const std::vector<QueryParameter>& parameters);
+
+private:
+	QueryStats();
+
+	static void Export(const StatementStats& stats);
+
+	// Updates the histograms; true if the statement is slow and sampled for the log
+	bool Observe(StatementStats& stats, std::chrono::nanoseconds elapsed, std::chrono::nanoseconds waited, uint64_t rows);
+
+	void LogSlow(const StatementStats& stats, std::chrono::nanoseconds elapsed, std::chrono::nanoseconds waited, uint64_t rows, const std::vector<QueryParameter>& parameters);
+
+	static constexpr size_t capacity = 256;
+
+	std::array<std::atomic<StatementStats*>, capacity> table{};
+	// labels beyond the table's capacity are counted together
+	StatementStats* overflow;
+
+	std::chrono::nanoseconds slowThreshold;
+	uint64_t sampleEvery;
+	std::atomic<uint64_t> slowQueries{ 0 };
+};
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <soci/soci.h>
+#include <cstddef>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+
+// A column of a row mapping: its name in the select list and the field it decodes into
+template <typename Row, typename Field>
+struct Column {
+	const char* name;
+	Field Row::* field;
+};
+
+// Specialised for every struct read from the database, with a constexpr tuple of Columns in select-list order:
+//	template <> struct RowMapping<Grade> { static constexpr std::tuple columns{ Column{ "id", &Grade::id }, ... }; };
+template <typename Row>
+struct RowMapping;
+
+// Select list for Row, e.g. "id, title, description"; built once
+// Queries read rows with it instead of *, so each column is at the position its mapping says
+template <typename Row>
+const std::string& ColumnList() {
+	static const std::string list = std::apply([](const auto&... column) {
+		std::string joined;
+		((joined += (joined.empty() ? "" : ", "), joined += column.name), ...);
+		return joined;
+	}, RowMapping<Row>::columns);
+
+	return list;
+}
+
+template <typename T>
+inline constexpr bool IsOptional = false;
+
+template <typename T>
+inline constexpr bool IsOptional<std::optional<T>> = true;
+
+// Reads the column at position into field; NULL only decodes into a std::optional field and throws for any other,
+// so a NULL in a column the struct does not expect is an error rather than a silently empty value
+template <typename Field>
+void DecodeColumn(const soci::values& values, std::size_t position, const char* name, Field& field) {
+	if (values.get_indicator(position) == soci::i_null) {
+		if constexpr (IsOptional<Field>) {
+			field = std::nullopt;
+			return;
+		}
+		else {
+			throw soci::soci_error(std::string("Unexpected NULL in column ") + name);
+		}
+	}
+
+	if constexpr (IsOptional<Field>) {
+		field = values.get<typename Field::value_type>(position);
+	}
+	else {
+		field = values.get<Field>(position);
+	}
+}
+
+// Decodes a row selected with ColumnList<Row>() by position, without looking any column up by name
+// Nullable columns must map to std::optional fields
+template <typename Row>
+void DecodeRow(const soci::values& values, Row& row) {
+	std::apply([&](const auto&... column) {
+		std::size_t position = 0;
+		(DecodeColumn(values, position++, column.name, row.*(column.field)), ...);
+	}, RowMapping<Row>::columns);
+}
+
+// Binds one field; an empty std::optional binds as NULL
+template <typename Field>
+void EncodeColumn(soci::values& values, const std::string& name, const Field& field) {
+	if constexpr (IsOptional<Field>) {
+		if (field.has_value()) {
+			values.set(name, *field);
+		}
+		else {
+			values.set(name, typename Field::value_type{}, soci::i_null);
+		}
+	}
+	else {
+		values.set(name, field);
+	}
+}
+
+// Binds the fields of a row by column name, for soci::use(row)
+template <typename Row>
+void EncodeRow(const Row& row, soci::values& values) {
+	std::apply([&](const auto&... column) {
+		// qualified names such as users.email bind as email
+		auto unqualified = [](std::string_view name) { return std::string(name.substr(name.find('.') + 1)); };
+		(EncodeColumn(values, unqualified(column.name), row.*(column.field)), ...);
+	}, RowMapping<Row>::columns);
+}
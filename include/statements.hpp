@@ -0,0 +1,240 @@
+#pragma once
+
+#include <libpq-fe.h>
+#include <array>
+#include <charconv>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Server-side prepared statement, prepared once on every pooled connection under its name
+struct PreparedStatement {
+	const char* name;
+	const char* sql;
+	int parameters;
+};
+
+// Statements on the hot paths; add new ones to All so the pool prepares them
+namespace Statements {
+	inline constexpr PreparedStatement SelectPrincipal{ "select_principal", "SELECT first_name, last_name, role FROM users WHERE id=$1", 1 };
+	inline constexpr PreparedStatement SelectMembership{ "select_membership", "SELECT 1 FROM classroom_users WHERE classroom_id=$1 AND user_id=$2", 2 };
+	inline constexpr PreparedStatement SelectAssignmentClassroom{ "select_assignment_classroom", "SELECT classroom_id FROM assignments WHERE id=$1", 1 };
+	inline constexpr PreparedStatement SelectSubmissionAssignment{ "select_submission_assignment", "SELECT assignment_id FROM submissions WHERE id=$1", 1 };
+
+	// How far a replica has replayed the primary's WAL, checked before it serves a client's read after a write
+	inline constexpr PreparedStatement SelectReplayLsn{ "select_replay_lsn", "SELECT pg_last_wal_replay_lsn()::text", 0 };
+
+	// $1 assignment, $2 user: the assignment with its files, the user's submissions and their files, and the user's grade if any,
+	// returned as the finished GetAssignment response next to the classroom id needed for the membership check
+	inline constexpr PreparedStatement SelectAssignmentDocument{ "select_assignment_document",
+		"SELECT a.classroom_id, (jsonb_build_object("
+			"'id', a.id, "
+			"'title', a.title, "
+			"'description', a.description, "
+			"'dueDate', to_char(a.due_date, 'DD-MM-YYYY HH24:MI:SS'), "
+			"'classroomId', a.classroom_id, "
+			"'files', files.links, "
+			"'submissions', submissions.list"
+		") || CASE WHEN grade.value IS NULL THEN '{}'::jsonb ELSE jsonb_build_object('grade', grade.value) END)::text "
+		"FROM assignments a "
+		"CROSS JOIN LATERAL (SELECT COALESCE(jsonb_agg(f.link ORDER BY f.id), '[]') AS links FROM assignment_files f WHERE f.assignment_id=a.id) files "
+		"CROSS JOIN LATERAL ("
+			"SELECT COALESCE(jsonb_agg(jsonb_build_object("
+				"'id', s.id, "
+				"'text', s.text, "
+				"'file_links', (SELECT COALESCE(jsonb_agg(fs.link ORDER BY fs.id), '[]') FROM file_submissions fs WHERE fs.submission_id=s.id)"
+			") ORDER BY s.id), '[]') AS list "
+			"FROM submissions s WHERE s.assignment_id=a.id AND s.user_id=$2"
+		") submissions "
+		"LEFT JOIN LATERAL (SELECT jsonb_build_object('id', g.id, 'grade', g.grade, 'feedback', g.feedback) AS value FROM assignment_grades g WHERE g.assignment_id=a.id AND g.user_id=$2 LIMIT 1) grade ON true "
+		"WHERE a.id=$1", 2 };
+
+	// Multi-row writes: the arrays are sent as one parameter so N rows cost one round trip
+	inline constexpr PreparedStatement InsertAssignmentFiles{ "insert_assignment_files", "INSERT INTO assignment_files (assignment_id, link) SELECT $1, unnest($2::text[])", 2 };
+	inline constexpr PreparedStatement InsertSubmissionFiles{ "insert_submission_files", "INSERT INTO file_submissions (submission_id, link) SELECT $1, unnest($2::text[])", 2 };
+	inline constexpr PreparedStatement DeleteAssignmentFiles{ "delete_assignment_files", "DELETE FROM assignment_files WHERE id = ANY($1::int[])", 1 };
+
+	// $1 classroom, $2 user ids: the ones that are members of the classroom
+	inline constexpr PreparedStatement SelectMembers{ "select_members", "SELECT user_id FROM classroom_users WHERE classroom_id=$1 AND user_id = ANY($2::int[])", 2 };
+
+	// $1 assignment: held until the transaction ends, so concurrent bulk grades of one assignment run one after another
+	// and neither inserts a grade the other has just inserted; keyed by the table's oid to stay clear of other advisory locks
+	inline constexpr PreparedStatement LockAssignmentGrades{ "lock_assignment_grades", "SELECT pg_advisory_xact_lock('assignment_grades'::regclass::oid::int, $1)", 1 };
+
+	// $1 assignment, $2 user ids, $3 grades, $4 feedback: one grade per user, replacing any the user already has
+	// assignment_grades has no unique (user_id, assignment_id) constraint to ON CONFLICT on, so existing grades are updated
+	// and the rest inserted; both parts see the table as it was before the statement, and LockAssignmentGrades keeps it that way
+	inline constexpr PreparedStatement UpsertGrades{ "upsert_grades",
+		"WITH input AS (SELECT * FROM unnest($2::int[], $3::float8[], $4::text[]) AS grades(user_id, grade, feedback)), "
+		"updated AS ("
+			"UPDATE assignment_grades g SET grade=input.grade, feedback=input.feedback FROM input "
+			"WHERE g.assignment_id=$1 AND g.user_id=input.user_id "
+			"RETURNING g.id, g.user_id, g.grade, g.feedback"
+		"), "
+		"inserted AS ("
+			"INSERT INTO assignment_grades (user_id, assignment_id, grade, feedback) "
+			"SELECT input.user_id, $1, input.grade, input.feedback FROM input "
+			"WHERE NOT EXISTS (SELECT 1 FROM assignment_grades g WHERE g.assignment_id=$1 AND g.user_id=input.user_id) "
+			"RETURNING id, user_id, grade, feedback"
+		") "
+		"SELECT id, user_id, grade, feedback FROM updated UNION ALL SELECT id, user_id, grade, feedback FROM inserted", 4 };
+
+	inline constexpr std::array<const PreparedStatement*, 12> All = {
+		&SelectPrincipal,
+		&SelectMembership,
+		&SelectAssignmentClassroom,
+		&SelectSubmissionAssignment,
+		&SelectReplayLsn,
+		&SelectAssignmentDocument,
+		&InsertAssignmentFiles,
+		&InsertSubmissionFiles,
+		&DeleteAssignmentFiles,
+		&SelectMembers,
+		&LockAssignmentGrades,
+		&UpsertGrades
+	};
+}
+
+// Postgres array literal for a text[], int[] or float8[] parameter, e.g. {"a","b\\"c"} or {1,2}
+inline std::string ToArrayLiteral(const std::vector<std::string>& values) {
+	std::string literal = "{";
+
+	for (size_t i = 0; i < values.size(); ++i) {
+		if (i > 0) {
+			literal += ',';
+		}
+
+		literal += '"';
+		for (char c : values[i]) {
+			if (c == '"' || c == '\\') {
+				literal += '\\';
+			}
+			literal += c;
+		}
+		literal += '"';
+	}
+
+	literal += '}';
+	return literal;
+}
+
+inline std::string ToArrayLiteral(const std::vector<int>& values) {
+	std::string literal = "{";
+
+	for (size_t i = 0; i < values.size(); ++i) {
+		if (i > 0) {
+			literal += ',';
+		}
+		literal += std::to_string(values[i]);
+	}
+
+	literal += '}';
+	return literal;
+}
+
+inline std::string ToArrayLiteral(const std::vector<double>& values) {
+	std::string literal = "{";
+	char buffer[32];
+
+	for (size_t i = 0; i < values.size(); ++i) {
+		if (i > 0) {
+			literal += ',';
+		}
+
+		// shortest text that parses back to the same double
+		auto [end, error] = std::to_chars(buffer, buffer + sizeof(buffer), values[i]);
+		literal.append(buffer, end);
+	}
+
+	literal += '}';
+	return literal;
+}
+
+// Text-format value of a statement argument
+inline std::string ToParameter(int value) {
+	return std::to_string(value);
+}
+
+inline const std::string& ToParameter(const std::string& value) {
+	return value;
+}
+
+inline std::string ToParameter(const std::vector<std::string>& values) {
+	return ToArrayLiteral(values);
+}
+
+inline std::string ToParameter(const std::vector<int>& values) {
+	return ToArrayLiteral(values);
+}
+
+inline std::string ToParameter(const std::vector<double>& values) {
+	return ToArrayLiteral(values);
+}
+
+// Owns a libpq result and reads its text-format columns
+class QueryResult {
+public:
+	// Takes ownership of the result; throws if the statement failed
+	explicit QueryResult(PGresult* result) : result(result) {
+		ExecStatusType status = PQresultStatus(result);
+
+		if (status != PGRES_TUPLES_OK && status != PGRES_COMMAND_OK) {
+			std::string message = result == nullptr ? "No result from database" : PQresultErrorMessage(result);
+			PQclear(result);
+			throw std::runtime_error(message);
+		}
+	}
+
+	QueryResult(QueryResult&& other) noexcept : result(other.result) {
+		other.result = nullptr;
+	}
+
+	QueryResult(const QueryResult&) = delete;
+	QueryResult& operator=(const QueryResult&) = delete;
+	QueryResult& operator=(QueryResult&&) = delete;
+
+	~QueryResult() {
+		if (result != nullptr) {
+			PQclear(result);
+		}
+	}
+
+	int Rows() const {
+		return PQntuples(result);
+	}
+
+	bool IsNull(int row, int column) const {
+		return PQgetisnull(result, row, column) == 1;
+	}
+
+	std::string_view Get(int row, int column) const {
+		return std::string_view(PQgetvalue(result, row, column), PQgetlength(result, row, column));
+	}
+
+	int GetInt(int row, int column) const {
+		std::string_view value = Get(row, column);
+		int number = 0;
+		std::from_chars(value.data(), value.data() + value.size(), number);
+		return number;
+	}
+
+	double GetDouble(int row, int column) const {
+		std::string_view value = Get(row, column);
+		double number = 0;
+		std::from_chars(value.data(), value.data() + value.size(), number);
+		return number;
+	}
+
+private:
+	PGresult* result;
+};
+
+namespace Statements {
+	// Prepares every statement in All on a connection; needed again after a reconnect
+	inline void PrepareAll(PGconn* connection) {
+		for (const PreparedStatement* statement : All) {
+			QueryResult(PQprepare(connection, statement->name, statement->sql, statement->parameters, nullptr));
+		}
+	}
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <soci/soci.h>
+#include <cstdint>
+#include <ctime>
+#include <optional>
+#include <string>
+#include <string_view>
+
+// A point in time in UTC, to the second
+// Parsed and formatted by hand: no std::tm round trip through get_time or put_time, and no mktime, which
+// locks and reads the timezone on every call
+class Timestamp {
+public:
+	constexpr Timestamp() = default;
+	constexpr explicit Timestamp(int64_t seconds) : seconds(seconds) {}
+
+	// "DD-MM-YYYY HH:MM:SS", the format clients send and are sent
+	static std::optional<Timestamp> Parse(std::string_view text);
+
+	// ISO-8601, "YYYY-MM-DDTHH:MM:SS" (or with a space for T), optional fraction and Z or +HH:MM / -HH:MM offset
+	static std::optional<Timestamp> ParseIso(std::string_view text);
+
+	// Current time from a coarse clock: cheap to read, at most a few milliseconds behind
+	static Timestamp Now();
+
+	// Fields read as UTC, as soci fills them from a timestamp column
+	static Timestamp FromTm(const std::tm& tm);
+	std::tm ToTm() const;
+
+	std::string Format() const;
+
+	constexpr int64_t Seconds() const {
+		return seconds;
+	}
+
+	constexpr auto operator<=>(const Timestamp&) const = default;
+
+private:
+	int64_t seconds = 0;
+};
+
+namespace soci
+{
+    template<>
+    struct type_conversion<Timestamp>
+    {
+        typedef std::tm base_type;
+
+        static void from_base(std::tm const& tm, indicator /* ind */, Timestamp& timestamp)
+        {
+            timestamp = Timestamp::FromTm(tm);
+        }
+
+        static void to_base(const Timestamp& timestamp, std::tm& tm, indicator& ind)
+        {
+            tm = timestamp.ToTm();
+            ind = i_ok;
+        }
+    };
+}
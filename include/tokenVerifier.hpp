@@ -0,0 +1,115 @@
+#pragma once
+
+#include "jwt-cpp/traits/nlohmann-json/traits.h"
+#include "lruCache.hpp"
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// The parts of a verified token the service uses
+struct TokenClaims {
+	std::string userId;
+	std::string issuer;
+	std::optional<std::chrono::system_clock::time_point> expiresAt = std::nullopt;
+	std::optional<std::chrono::system_clock::time_point> notBefore = std::nullopt;
+	std::optional<std::chrono::system_clock::time_point> issuedAt = std::nullopt;
+	// sorted ids from the signed "classrooms" claim, only read when TRUST_CLASSROOM_CLAIMS is on
+	std::shared_ptr<const std::vector<int>> classrooms = nullptr;
+
+	// checked again on every cache hit, so a cached token is only valid for as long as the token itself
+	bool IsCurrent(std::chrono::system_clock::time_point now) const {
+		return (!expiresAt.has_value() || now < *expiresAt) && (!notBefore.has_value() || now >= *notBefore);
+	}
+};
+
+// SHA-256 of the raw token; the token itself is never kept in the cache
+using TokenDigest = std::array<unsigned char, 32>;
+
+struct TokenDigestHash {
+	size_t operator()(const TokenDigest& digest) const {
+		size_t hash;
+		std::memcpy(&hash, digest.data(), sizeof(hash));
+		return hash;
+	}
+};
+
+// Holds the JWT verifiers, parsed once instead of on every request
+// Tokens carrying a kid are checked against that key from the JWT_KEYS ring, which may be RS512, ES256 or EdDSA (Ed25519);
+// tokens without one are checked against the RS512 RSASECRET key, and tokens with a kid not in the ring are rejected
+// The key ring is immutable and shared by all handler threads; Reload swaps in a new one atomically
+// Tokens that passed verification are remembered so repeated calls with the same token skip the signature check
+class TokenVerifier {
+public:
+	using Verifier = jwt::verifier<jwt::default_clock, jwt::traits::nlohmann_json>;
+
+	TokenVerifier(const TokenVerifier&) = delete;
+
+	static TokenVerifier* GetInstance() {
+		static TokenVerifier* instance = new TokenVerifier();
+		return instance;
+	}
+
+	using DecodedToken = jwt::decoded_jwt<jwt::traits::nlohmann_json>;
+
+	// Verifier for the key the token was signed with, or nullptr if there is no such key
+	std::shared_ptr<const Verifier> VerifierFor(const DecodedToken& token) const;
+
+	// Parses the keys and swaps them in; throws and keeps the current keys if any cannot be parsed
+	// keyRing is a JSON array of { "kid", "alg", "key" } with PEM public keys, defaultPem may be empty if every token has a kid
+	// Tokens verified with the old keys are forgotten
+	void Reload(std::string defaultPem, const std::string& keyRing = "[]");
+
+	// Reads RSASECRET and the key ring from JWT_KEYS_FILE, or from JWT_KEYS if no file is set
+	void ReloadFromEnvironment();
+
+	// Reloads from the environment whenever the process gets SIGHUP, so JWT_KEYS_FILE can be rotated without a restart
+	// Must be called before any other thread starts, so the signal is delivered to the watcher thread only
+	static void ReloadOnHangup();
+
+	static TokenDigest Digest(const std::string& token);
+
+	// Changes with every Reload; read it before VerifierFor and pass it to Remember, so a token verified with keys
+	// that were replaced in the meantime is never served from the cache
+	uint64_t Generation() const {
+		return generation.load(std::memory_order_acquire);
+	}
+
+	// Claims of a previously verified token, if they are still current and were verified with the current keys
+	std::optional<TokenClaims> Lookup(const TokenDigest& digest);
+
+	// Remembers a verified token; verifyCost is what each later hit saves
+	void Remember(const TokenDigest& digest, const TokenClaims& claims, uint64_t verifiedGeneration, std::chrono::nanoseconds verifyCost);
+
+private:
+	TokenVerifier();
+
+	struct KeyRing {
+		std::shared_ptr<const Verifier> fallback;
+		std::unordered_map<std::string, std::shared_ptr<const Verifier>> byKeyId;
+	};
+
+	struct CachedClaims {
+		TokenClaims claims;
+		uint64_t generation = 0;
+	};
+
+	std::atomic<std::shared_ptr<const KeyRing>> keyRing;
+	std::atomic<uint64_t> generation{ 0 };
+
+	ShardedLruCache<TokenDigest, CachedClaims, TokenDigestHash> claimsCache;
+	// tokens without exp are still re-verified after this long
+	std::chrono::seconds maxCacheAge;
+
+	// counted here rather than by the cache, which cannot tell an expired token or a stale generation from a hit
+	std::atomic<uint64_t> hits{ 0 };
+	std::atomic<uint64_t> misses{ 0 };
+
+	std::atomic<uint64_t> verifyNanos{ 0 };
+	std::atomic<uint64_t> verifyCount{ 0 };
+};
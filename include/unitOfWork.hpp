@@ -0,0 +1,57 @@
+#pragma once
+
+#include "CppHttp.hpp"
+#include "database.hpp"
+#include <functional>
+
+// A handler's writes, applied in one transaction on one pooled session
+// Rolls back on destruction unless Commit was called
+class UnitOfWork {
+public:
+	using Work = std::function<void(Database::Connection&)>;
+
+	UnitOfWork();
+
+	UnitOfWork(const UnitOfWork&) = delete;
+	UnitOfWork& operator=(const UnitOfWork&) = delete;
+
+	~UnitOfWork();
+
+	Database::Connection& Connection() {
+		return connection;
+	}
+
+	void Commit();
+
+	// Runs work in a transaction and commits it, rethrowing whatever work throws
+	// When GROUP_COMMIT_WINDOW_MS is set, work from concurrent callers arriving within that window shares
+	// one transaction and one commit; each caller's work runs under its own savepoint, so one failing does not undo the others
+	static void Run(Work work);
+
+	// Run for coroutine handlers: awaits the commit instead of blocking a thread on it
+	static CppHttp::Net::Task<void> RunAsync(Work work);
+
+private:
+	Database::Connection connection;
+	bool active = true;
+};
+
+// A read-only handler's queries, run on one session in one repeatable-read transaction, so a page and the rows
+// joined to it all come from the same snapshot even on a replica that keeps replaying between the statements
+// The session comes from Database::LeaseForRead(readToken)
+class ReadSnapshot {
+public:
+	explicit ReadSnapshot(const std::string& readToken);
+
+	ReadSnapshot(const ReadSnapshot&) = delete;
+	ReadSnapshot& operator=(const ReadSnapshot&) = delete;
+
+	~ReadSnapshot();
+
+	Database::Connection& Connection() {
+		return connection;
+	}
+
+private:
+	Database::Connection connection;
+};
@@ -0,0 +1,54 @@
+#pragma once
+
+#include "config.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <thread>
+#include <vector>
+
+// Runs work(0) ... work(count - 1) on up to STARTUP_THREADS threads (16 by default) and waits for all of them
+// Meant for startup steps that mostly wait on the network; rethrows the first failure once every step has finished
+template <typename Work>
+void RunInParallel(size_t count, Work work) {
+	std::vector<std::exception_ptr> failures(count);
+	std::atomic<size_t> next{ 0 };
+
+	// each thread takes the next step until none are left
+	auto run = [&work, &failures, &next, count]() {
+		for (size_t i = next.fetch_add(1); i < count; i = next.fetch_add(1)) {
+			try {
+				work(i);
+			}
+			catch (...) {
+				failures[i] = std::current_exception();
+			}
+		}
+	};
+
+	size_t threadCount = std::min<size_t>(count, std::max<long long>(1, GetEnvNumber("STARTUP_THREADS", 16)));
+	std::vector<std::thread> threads;
+	threads.reserve(threadCount);
+
+	for (size_t i = 0; i < threadCount; ++i) {
+		threads.emplace_back(run);
+	}
+
+	for (std::thread& thread : threads) {
+		thread.join();
+	}
+
+	for (std::exception_ptr& failure : failures) {
+		if (failure != nullptr) {
+			std::rethrow_exception(failure);
+		}
+	}
+}
+
+// Builds everything the first requests would otherwise build lazily, before the server accepts connections:
+// the database pools and nonblocking connections with their statements prepared, the token verifier with its key
+// parsed, the blob storage client with a connection to the assignments container and the membership cache
+// With WARMUP_PRELOAD_ASSIGNMENTS > 0, also fills the membership cache for the classrooms of that many of the newest assignments
+// Throws if a step fails, so a broken instance never reports ready
+void Warmup();
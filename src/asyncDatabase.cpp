@@ -0,0 +1,244 @@
+#include "../include/asyncDatabase.hpp"
+#include "../include/config.hpp"
+#include "../include/database.hpp"
+#include "../include/metrics.hpp"
+#include "../include/warmup.hpp"
+#include <optional>
+#include <syncstream>
+
+AsyncDatabase::Server::Server(std::string name, std::string connectionString, size_t size) :
+	name(std::move(name)),
+	connectionString(std::move(connectionString)),
+	slots(size)
+{
+	for (Slot& slot : slots) {
+		slot.server = this;
+	}
+
+	std::string label = "{server=\"" + this->name + "\"}";
+
+	Metrics* metrics = Metrics::GetInstance();
+	metrics->Register("db_async_connections" + label, Metrics::Type::GAUGE, "Nonblocking database connections", [this]() {
+		return (double)this->slots.size();
+	});
+	metrics->Register("db_async_in_use" + label, Metrics::Type::GAUGE, "Nonblocking connections currently running a query", [this]() {
+		return (double)this->inUse.load(std::memory_order_relaxed);
+	});
+	metrics->Register("db_async_waiters" + label, Metrics::Type::GAUGE, "Queries waiting for a free nonblocking connection", [this]() {
+		std::lock_guard<std::mutex> lock(this->mutex);
+		return (double)this->waiters.size();
+	});
+	metrics->Register("db_async_queries_total" + label, Metrics::Type::COUNTER, "Queries run on nonblocking connections", [this]() {
+		return (double)this->queries.load(std::memory_order_relaxed);
+	});
+	metrics->Register("db_async_reconnects_total" + label, Metrics::Type::COUNTER, "Broken nonblocking connections reopened", [this]() {
+		return (double)this->reconnects.load(std::memory_order_relaxed);
+	});
+}
+
+AsyncDatabase::AsyncDatabase() {
+	size_t size = std::max<long long>(1, GetEnvNumber("DB_ASYNC_POOL_SIZE", 4));
+
+	primary = std::make_unique<Server>("primary", Database::ConnectionString(std::getenv("PG_HOST"), std::getenv("PG_PORT")), size);
+	for (const std::string& connectionString : Database::ReplicaConnectionStrings()) {
+		replicas.push_back(std::make_unique<Server>("replica" + std::to_string(replicas.size()), connectionString, size));
+	}
+
+	std::vector<Slot*> all;
+	for (Slot& slot : primary->slots) {
+		all.push_back(&slot);
+	}
+	for (auto& replica : replicas) {
+		for (Slot& slot : replica->slots) {
+			all.push_back(&slot);
+		}
+	}
+
+	RunInParallel(all.size(), [this, &all](size_t i) {
+		Connect(*all[i]);
+	});
+
+	for (Slot* slot : all) {
+		slot->server->free.push_back(slot);
+	}
+
+	Metrics* metrics = Metrics::GetInstance();
+	metrics->Register("db_async_replica_reads_total", Metrics::Type::COUNTER, "Nonblocking reads served by a replica", [this]() {
+		return (double)this->replicaReads.load(std::memory_order_relaxed);
+	});
+	metrics->Register("db_async_replica_fallbacks_total", Metrics::Type::COUNTER, "Nonblocking reads sent to the primary because the replica had not replayed the client's last write", [this]() {
+		return (double)this->primaryFallbacks.load(std::memory_order_relaxed);
+	});
+}
+
+void AsyncDatabase::Connect(Slot& slot) {
+	if (slot.connection == nullptr) {
+		slot.connection = PQconnectdb(slot.server->connectionString.c_str());
+	}
+	else {
+		PQreset(slot.connection);
+	}
+
+	if (PQstatus(slot.connection) != CONNECTION_OK) {
+		throw std::runtime_error(std::string("Failed to connect to the database: ") + PQerrorMessage(slot.connection));
+	}
+
+	// statements are prepared synchronously, PQprepare ignores nonblocking mode
+	Statements::PrepareAll(slot.connection);
+
+	if (PQsetnonblocking(slot.connection, 1) != 0) {
+		throw std::runtime_error(std::string("Failed to make the database connection nonblocking: ") + PQerrorMessage(slot.connection));
+	}
+}
+
+void AsyncDatabase::Release(Slot* slot) {
+	Server& server = *slot->server;
+	server.inUse.fetch_sub(1, std::memory_order_relaxed);
+
+	if (PQstatus(slot->connection) == CONNECTION_OK) {
+		GiveBack(slot);
+		return;
+	}
+
+	// reconnecting blocks, so it runs on the blocking pool instead of the worker that resumed the query;
+	// the slot stays out of the free list until it is done, so no other query is handed the broken connection
+	std::osyncstream(std::cout) << "\033[33m[!] Reconnecting nonblocking " << server.name << " database connection\033[0m\n";
+	server.reconnects.fetch_add(1, std::memory_order_relaxed);
+
+	CppHttp::Net::ThreadPool::Blocking().Post([this, slot]() {
+		try {
+			Connect(*slot);
+		}
+		catch (std::exception& e) {
+			// the next query on it fails and tries again
+			std::osyncstream(std::cout) << "\033[31m[-] " << e.what() << "\033[0m\n";
+		}
+
+		GiveBack(slot);
+	});
+}
+
+void AsyncDatabase::GiveBack(Slot* slot) {
+	Server& server = *slot->server;
+
+	Acquire* waiter = nullptr;
+	{
+		std::lock_guard<std::mutex> lock(server.mutex);
+
+		if (server.waiters.empty()) {
+			server.free.push_back(slot);
+			return;
+		}
+
+		waiter = server.waiters.front();
+		server.waiters.pop_front();
+		waiter->slot = slot;
+	}
+
+	std::coroutine_handle<> awaiting = waiter->awaiting;
+	waiter->resumeOn->Post([awaiting]() { awaiting.resume(); });
+}
+
+CppHttp::Net::Task<QueryResult> AsyncDatabase::RunForRead(std::string readToken, const PreparedStatement& statement, Arguments arguments) {
+	if (replicas.empty()) {
+		co_return co_await Run(*primary, statement, std::move(arguments));
+	}
+
+	Server& replica = *replicas[nextReplica.fetch_add(1, std::memory_order_relaxed) % replicas.size()];
+	uint64_t required = Database::ParseLsn(readToken);
+
+	// unless the replica was already seen past the client's write, ask it how far it has got
+	if (required != 0 && replica.replayedLsn.load(std::memory_order_relaxed) < required) {
+		QueryResult replayed = co_await Run(replica, Statements::SelectReplayLsn, {});
+
+		uint64_t lsn = Database::ParseLsn(std::string(replayed.Get(0, 0)));
+		uint64_t seen = replica.replayedLsn.load(std::memory_order_relaxed);
+		while (lsn > seen && !replica.replayedLsn.compare_exchange_weak(seen, lsn, std::memory_order_relaxed)) {}
+
+		if (lsn < required) {
+			primaryFallbacks.fetch_add(1, std::memory_order_relaxed);
+			co_return co_await Run(*primary, statement, std::move(arguments));
+		}
+	}
+
+	replicaReads.fetch_add(1, std::memory_order_relaxed);
+	co_return co_await Run(replica, statement, std::move(arguments));
+}
+
+CppHttp::Net::Task<PGresult*> AsyncDatabase::Send(PGconn* connection, const PreparedStatement& statement, const Arguments& arguments) {
+	CppHttp::Net::Reactor& reactor = CppHttp::Net::Reactor::Instance();
+
+	std::vector<const char*> pointers;
+	for (auto& value : arguments.values) {
+		pointers.push_back(value.c_str());
+	}
+
+	if (PQsendQueryPrepared(connection, statement.name, statement.parameters, pointers.data(), nullptr, nullptr, 0) == 0) {
+		throw std::runtime_error(PQerrorMessage(connection));
+	}
+
+	// a large query may not fit in the socket buffer at once
+	int flushed = 0;
+	while ((flushed = PQflush(connection)) == 1) {
+		co_await reactor.Writable(PQsocket(connection));
+	}
+
+	if (flushed == -1) {
+		throw std::runtime_error(PQerrorMessage(connection));
+	}
+
+	// keep only the first result, and read until libpq reports the query finished so the connection can take the next one
+	PGresult* result = nullptr;
+	while (true) {
+		while (PQisBusy(connection)) {
+			co_await reactor.Readable(PQsocket(connection));
+
+			if (PQconsumeInput(connection) == 0) {
+				PQclear(result);
+				throw std::runtime_error(PQerrorMessage(connection));
+			}
+		}
+
+		PGresult* next = PQgetResult(connection);
+		if (next == nullptr) {
+			break;
+		}
+
+		if (result == nullptr) {
+			result = next;
+		}
+		else {
+			PQclear(next);
+		}
+	}
+
+	co_return result;
+}
+
+CppHttp::Net::Task<QueryResult> AsyncDatabase::Run(Server& server, const PreparedStatement& statement, Arguments arguments) {
+	auto waitStart = std::chrono::steady_clock::now();
+	Slot* slot = co_await Acquire(server);
+	std::chrono::nanoseconds waited = std::chrono::steady_clock::now() - waitStart;
+
+	server.inUse.fetch_add(1, std::memory_order_relaxed);
+	server.queries.fetch_add(1, std::memory_order_relaxed);
+
+	Lease lease{ this, slot };
+	StatementStats& stats = QueryStats::GetInstance()->For(statement.name);
+	auto start = std::chrono::steady_clock::now();
+
+	auto describe = [&arguments]() { return arguments.Described(); };
+	std::optional<QueryResult> rows;
+
+	try {
+		rows.emplace(co_await Send(slot->connection, statement, arguments));
+	}
+	catch (...) {
+		QueryStats::GetInstance()->Record(stats, std::chrono::steady_clock::now() - start, waited, 0, describe);
+		throw;
+	}
+
+	QueryStats::GetInstance()->Record(stats, std::chrono::steady_clock::now() - start, waited, rows->Rows(), describe);
+
+	co_return std::move(*rows);
+}
@@ -0,0 +1,260 @@
+#include "../include/auth.hpp"
+#include "../include/endpoints.hpp"
+#include "../include/tokenVerifier.hpp"
+#include "../include/config.hpp"
+#include "../include/lruCache.hpp"
+#include "../include/metrics.hpp"
+
+Role ParseRole(std::string role) {
+	std::transform(role.begin(), role.end(), role.begin(), ::toupper);
+
+	if (role == "ADMIN") {
+		return Role::ADMIN;
+	}
+	if (role == "TEACHER") {
+		return Role::TEACHER;
+	}
+
+	return Role::STUDENT;
+}
+
+namespace {
+	// users and roles are written by the user service, not here, so a name or role change shows up once the entry expires
+	const std::chrono::seconds principalTtl(GetEnvNumber("PRINCIPAL_CACHE_TTL", 60));
+
+	// Opt-in: authorize classroom access from a "classrooms" claim signed by the auth service,
+	// as long as the token was issued no more than CLASSROOM_CLAIM_MAX_AGE seconds ago
+	const bool trustClassroomClaims = GetEnvNumber("TRUST_CLASSROOM_CLAIMS", 0) != 0;
+	const std::chrono::seconds classroomClaimMaxAge(GetEnvNumber("CLASSROOM_CLAIM_MAX_AGE", 300));
+
+	struct AuthStatistics {
+		std::atomic<uint64_t> requests{ 0 };
+		std::atomic<uint64_t> withoutDatabase{ 0 };
+	};
+
+	AuthStatistics& Statistics() {
+		static AuthStatistics* statistics = []() {
+			auto* stats = new AuthStatistics();
+
+			Metrics* metrics = Metrics::GetInstance();
+			metrics->Register("auth_requests_total", Metrics::Type::COUNTER, "Authenticated requests", [stats]() {
+				return (double)stats->requests.load(std::memory_order_relaxed);
+			});
+			metrics->Register("auth_requests_without_db_total", Metrics::Type::COUNTER, "Authenticated requests whose authentication and membership checks needed no database query", [stats]() {
+				return (double)stats->withoutDatabase.load(std::memory_order_relaxed);
+			});
+			metrics->Register("auth_requests_without_db_ratio", Metrics::Type::GAUGE, "Fraction of authenticated requests that needed no database query for auth", [stats]() {
+				uint64_t requests = stats->requests.load(std::memory_order_relaxed);
+				return requests == 0 ? 0.0 : stats->withoutDatabase.load(std::memory_order_relaxed) / (double)requests;
+			});
+
+			return stats;
+		}();
+
+		return *statistics;
+	}
+
+	// Accepts [1, 2] as well as [{ "id": 1, "role": "teacher" }]; anything else makes the whole claim unusable
+	std::shared_ptr<const std::vector<int>> ParseClassroomClaim(const json& claim) {
+		if (!claim.is_array()) {
+			return nullptr;
+		}
+
+		auto ids = std::make_shared<std::vector<int>>();
+		ids->reserve(claim.size());
+
+		for (auto& entry : claim) {
+			const json* value = &entry;
+
+			if (entry.is_object()) {
+				auto id = entry.find("id");
+				if (id == entry.end()) {
+					return nullptr;
+				}
+				value = &*id;
+			}
+
+			if (!value->is_number_integer()) {
+				return nullptr;
+			}
+
+			ids->push_back(value->get<int>());
+		}
+
+		std::sort(ids->begin(), ids->end());
+
+		return ids;
+	}
+
+	ShardedLruCache<int, Principal>& PrincipalCache() {
+		static ShardedLruCache<int, Principal>* cache = []() {
+			auto* principals = new ShardedLruCache<int, Principal>(GetEnvNumber("PRINCIPAL_CACHE_SIZE", 10000));
+
+			Metrics* metrics = Metrics::GetInstance();
+			metrics->Register("principal_cache_hits_total", Metrics::Type::COUNTER, "Authenticated requests whose user was found in the principal cache", [principals]() {
+				return (double)principals->Hits();
+			});
+			metrics->Register("principal_cache_misses_total", Metrics::Type::COUNTER, "Authenticated requests that loaded their user from the database", [principals]() {
+				return (double)principals->Misses();
+			});
+
+			return principals;
+		}();
+
+		return *cache;
+	}
+}
+
+std::variant<TokenError, TokenClaims> ValidateToken(std::string& token) {
+	// remove "Bearer "
+	token.erase(0, 7);
+
+	if (token.empty()) {
+		return TokenError{ CppHttp::Net::ResponseType::NOT_AUTHORIZED, "Missing token" };
+	}
+
+	TokenVerifier* tokenVerifier = TokenVerifier::GetInstance();
+	TokenDigest digest = TokenVerifier::Digest(token);
+
+	std::optional<TokenClaims> cached = tokenVerifier->Lookup(digest);
+	if (cached.has_value()) {
+		return std::move(*cached);
+	}
+
+	auto verifyStart = std::chrono::steady_clock::now();
+
+	std::optional<TokenVerifier::DecodedToken> decodedToken;
+
+	try {
+		decodedToken.emplace(jwt::decode<jwt::traits::nlohmann_json>(token));
+	}
+	catch (std::exception&) {
+		return TokenError{ CppHttp::Net::ResponseType::NOT_AUTHORIZED, "Invalid token" };
+	}
+
+	uint64_t generation = tokenVerifier->Generation();
+	std::shared_ptr<const TokenVerifier::Verifier> verifier = tokenVerifier->VerifierFor(*decodedToken);
+
+	if (verifier == nullptr) {
+		return TokenError{ CppHttp::Net::ResponseType::NOT_AUTHORIZED, "Unknown signing key" };
+	}
+
+	std::error_code ec;
+	verifier->verify(*decodedToken, ec);
+
+	if (ec) {
+		std::osyncstream(std::cout) << "\033[1;31m[-] Error: " << ec.message() << "\033[0m\n";
+		return TokenError{ CppHttp::Net::ResponseType::NOT_AUTHORIZED, ec.message() };
+	}
+
+	if (!decodedToken->has_payload_claim("id") || decodedToken->get_payload_claim("id").get_type() != jwt::json::type::string) {
+		return TokenError{ CppHttp::Net::ResponseType::NOT_AUTHORIZED, "Invalid token" };
+	}
+
+	TokenClaims claims{ decodedToken->get_payload_claim("id").as_string(), decodedToken->get_issuer(), std::nullopt, std::nullopt, std::nullopt, nullptr };
+
+	if (decodedToken->has_expires_at()) {
+		claims.expiresAt = decodedToken->get_expires_at();
+	}
+	if (decodedToken->has_not_before()) {
+		claims.notBefore = decodedToken->get_not_before();
+	}
+	if (decodedToken->has_issued_at()) {
+		claims.issuedAt = decodedToken->get_issued_at();
+	}
+	if (trustClassroomClaims && decodedToken->has_payload_claim("classrooms")) {
+		claims.classrooms = ParseClassroomClaim(decodedToken->get_payload_claim("classrooms").to_json());
+	}
+
+	tokenVerifier->Remember(digest, claims, generation, std::chrono::steady_clock::now() - verifyStart);
+
+	return claims;
+}
+
+CppHttp::Net::Task<std::optional<returnType>> Authenticate(CppHttp::Net::Request& req) {
+	std::string token = req.m_info.headers["Authorization"];
+
+	auto tokenResult = ValidateToken(token);
+
+	if (std::holds_alternative<TokenError>(tokenResult)) {
+		auto error = std::get<TokenError>(tokenResult);
+		co_return returnType{ error.type, error.message, {} };
+	}
+
+	TokenClaims& claims = std::get<TokenClaims>(tokenResult);
+	std::optional<int> userId = ParseId(claims.userId);
+
+	if (!userId.has_value()) {
+		co_return returnType{ CppHttp::Net::ResponseType::NOT_AUTHORIZED, "Invalid token", {} };
+	}
+
+	int id = *userId;
+
+	auto& principals = PrincipalCache();
+
+	// a claim issued too long ago may no longer reflect the user's classrooms
+	std::shared_ptr<const std::vector<int>> classrooms;
+	if (claims.classrooms != nullptr && claims.issuedAt.has_value() && std::chrono::system_clock::now() - *claims.issuedAt <= classroomClaimMaxAge) {
+		classrooms = std::move(claims.classrooms);
+	}
+
+	std::optional<Principal> cached = principals.Get(id);
+	if (cached.has_value()) {
+		cached->classrooms = std::move(classrooms);
+		req.m_info.principal = std::move(*cached);
+		co_return std::nullopt;
+	}
+
+	Principal principal;
+	{
+		QueryResult result = co_await AsyncDatabase::GetInstance()->Execute(Statements::SelectPrincipal, id);
+
+		if (result.Rows() == 0) {
+			co_return returnType{ CppHttp::Net::ResponseType::NOT_AUTHORIZED, "Not authorized", {} };
+		}
+
+		principal = Principal{ id, std::string(result.Get(0, 0)), std::string(result.Get(0, 1)), ParseRole(std::string(result.Get(0, 2))), nullptr, false };
+	}
+
+	principals.Put(id, principal, principalTtl);
+
+	principal.classrooms = std::move(classrooms);
+	principal.usedDatabase = true;
+	req.m_info.principal = std::move(principal);
+
+	co_return std::nullopt;
+}
+
+const Principal& GetPrincipal(CppHttp::Net::Request& req) {
+	return std::any_cast<const Principal&>(req.m_info.principal);
+}
+
+bool IsClassroomMember(const Principal& principal, int classroomId) {
+	if (principal.classrooms != nullptr) {
+		return std::binary_search(principal.classrooms->begin(), principal.classrooms->end(), classroomId);
+	}
+
+	bool queried = false;
+	bool member = Membership::GetInstance()->IsMember(classroomId, principal.id, &queried);
+
+	if (queried) {
+		principal.usedDatabase = true;
+	}
+
+	return member;
+}
+
+void RecordAuthStatistics(CppHttp::Net::Request& req, [[maybe_unused]] const returnType& response) {
+	// requests rejected before a principal was attached, and unauthenticated routes, are not counted
+	const Principal* principal = std::any_cast<Principal>(&req.m_info.principal);
+	if (principal == nullptr) {
+		return;
+	}
+
+	AuthStatistics& statistics = Statistics();
+	statistics.requests.fetch_add(1, std::memory_order_relaxed);
+
+	if (!principal->usedDatabase) {
+		statistics.withoutDatabase.fetch_add(1, std::memory_order_relaxed);
+	}
+}
\ No newline at end of file
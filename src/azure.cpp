@@ -1,4 +1,3 @@
 #include "../include/azure.hpp"
 
-Blobs* Blobs::azureInstance = nullptr;
 std::mutex Blobs::azureMutex;
\ No newline at end of file
@@ -1,4 +1,234 @@
 #include "database.hpp"
+#include "config.hpp"
+#include "metrics.hpp"
+#include "warmup.hpp"
+#include <sstream>
+#include <stdexcept>
+#include <syncstream>
+#include <thread>
 
-Database* Database::databaseInstance = nullptr;
-std::mutex Database::dbMutex;
\ No newline at end of file
+uint64_t Database::ParseLsn(const std::string& lsn) {
+	size_t slash = lsn.find('/');
+	if (slash == std::string::npos || slash == 0 || slash == lsn.size() - 1) {
+		return 0;
+	}
+
+	char* end = nullptr;
+	uint64_t high = std::strtoull(lsn.c_str(), &end, 16);
+	if (end != lsn.c_str() + slash) {
+		return 0;
+	}
+
+	uint64_t low = std::strtoull(lsn.c_str() + slash + 1, &end, 16);
+	if (*end != '\0') {
+		return 0;
+	}
+
+	return (high << 32) | low;
+}
+
+std::string Database::ConnectionString(const std::string& host, const std::string& port) {
+	return "dbname=" + (std::string)std::getenv("PG_DB") + " user=" + (std::string)std::getenv("PG_USER") + " password=" + (std::string)std::getenv("PG_PASS") + " host=" + host + " port=" + port + " sslmode=require";
+}
+
+std::vector<std::string> Database::ReplicaConnectionStrings() {
+	std::vector<std::string> connectionStrings;
+
+	const char* replicaHosts = std::getenv("PG_REPLICA_HOSTS");
+	if (replicaHosts == nullptr || *replicaHosts == '\0') {
+		return connectionStrings;
+	}
+
+	std::string port = std::getenv("PG_PORT");
+	std::istringstream hosts(replicaHosts);
+	std::string host;
+
+	while (std::getline(hosts, host, ',')) {
+		if (host.empty()) {
+			continue;
+		}
+
+		size_t colon = host.find(':');
+		std::string replicaPort = colon == std::string::npos ? port : host.substr(colon + 1);
+		host = host.substr(0, colon);
+
+		connectionStrings.push_back(ConnectionString(host, replicaPort));
+	}
+
+	return connectionStrings;
+}
+
+Database::Pool::Pool(std::string name, const std::string& connectionString, size_t size, std::chrono::milliseconds leaseTimeout) :
+	name(std::move(name)),
+	size(size),
+	leaseTimeout(leaseTimeout),
+	pool(size)
+{
+	// every session pays for its own TLS handshake, so they are opened side by side
+	RunInParallel(size, [this, &connectionString](size_t i) {
+		pool.at(i).open(postgresql, connectionString);
+		PrepareStatements(pool.at(i));
+	});
+
+	std::string label = "{pool=\"" + this->name + "\"}";
+
+	Metrics* metrics = Metrics::GetInstance();
+	metrics->Register("db_pool_size" + label, Metrics::Type::GAUGE, "Sessions in the database pool", [this]() {
+		return (double)this->size;
+	});
+	metrics->Register("db_pool_in_use" + label, Metrics::Type::GAUGE, "Sessions currently leased", [this]() {
+		return (double)this->inUse.load(std::memory_order_relaxed);
+	});
+	metrics->Register("db_pool_utilization" + label, Metrics::Type::GAUGE, "Fraction of the pool currently leased", [this]() {
+		return this->inUse.load(std::memory_order_relaxed) / (double)this->size;
+	});
+	metrics->Register("db_pool_leases_total" + label, Metrics::Type::COUNTER, "Sessions leased from the pool", [this]() {
+		return (double)this->leases.load(std::memory_order_relaxed);
+	});
+	metrics->Register("db_pool_wait_seconds_total" + label, Metrics::Type::COUNTER, "Time spent waiting for a free session", [this]() {
+		return this->leaseWaitNanos.load(std::memory_order_relaxed) / 1e9;
+	});
+	metrics->Register("db_pool_lease_timeouts_total" + label, Metrics::Type::COUNTER, "Leases that gave up waiting for a free session", [this]() {
+		return (double)this->leaseTimeouts.load(std::memory_order_relaxed);
+	});
+	metrics->Register("db_pool_reconnects_total" + label, Metrics::Type::COUNTER, "Broken sessions reconnected when leased", [this]() {
+		return (double)this->reconnects.load(std::memory_order_relaxed);
+	});
+}
+
+Database::Connection Database::Pool::Lease() {
+	auto waitStart = std::chrono::steady_clock::now();
+
+	size_t position = 0;
+	bool leased = pool.try_lease(position, (int)leaseTimeout.count());
+
+	std::chrono::nanoseconds waited = std::chrono::steady_clock::now() - waitStart;
+	leaseWaitNanos.fetch_add(waited.count(), std::memory_order_relaxed);
+
+	if (!leased) {
+		leaseTimeouts.fetch_add(1, std::memory_order_relaxed);
+		throw std::runtime_error("Timed out waiting for a database connection");
+	}
+
+	leases.fetch_add(1, std::memory_order_relaxed);
+	inUse.fetch_add(1, std::memory_order_relaxed);
+
+	// from here on the connection gives the session back, even if reconnecting throws
+	Connection connection(this, position, waited);
+
+	soci::session& session = pool.at(position);
+	if (!session.is_connected()) {
+		std::osyncstream(std::cout) << "\033[33m[!] Reconnecting " << name << " database session " << position << "\033[0m\n";
+		reconnects.fetch_add(1, std::memory_order_relaxed);
+		session.reconnect();
+		PrepareStatements(session);
+	}
+
+	return connection;
+}
+
+void Database::Pool::GiveBack(size_t position) {
+	inUse.fetch_sub(1, std::memory_order_relaxed);
+	pool.give_back(position);
+}
+
+Database::Database() {
+	size_t poolSize = std::max<long long>(1, GetEnvNumber("DB_POOL_SIZE", std::max(4u, std::thread::hardware_concurrency())));
+	std::chrono::milliseconds leaseTimeout(GetEnvNumber("DB_LEASE_TIMEOUT_MS", 5000));
+	primary = std::make_unique<Pool>("primary", ConnectionString(std::getenv("PG_HOST"), std::getenv("PG_PORT")), poolSize, leaseTimeout);
+
+	size_t replicaPoolSize = std::max<long long>(1, GetEnvNumber("DB_REPLICA_POOL_SIZE", poolSize));
+	for (const std::string& connectionString : ReplicaConnectionStrings()) {
+		replicas.push_back(std::make_unique<Pool>("replica" + std::to_string(replicas.size()), connectionString, replicaPoolSize, leaseTimeout));
+	}
+
+	Metrics* metrics = Metrics::GetInstance();
+	metrics->Register("db_replica_reads_total", Metrics::Type::COUNTER, "Read-only requests served by a replica", [this]() {
+		return (double)this->replicaReads.load(std::memory_order_relaxed);
+	});
+	metrics->Register("db_replica_fallbacks_total", Metrics::Type::COUNTER, "Read-only requests sent to the primary because the replica had not replayed the client's last write", [this]() {
+		return (double)this->primaryFallbacks.load(std::memory_order_relaxed);
+	});
+}
+
+Database::Connection Database::LeaseForRead(const std::string& readToken) {
+	if (replicas.empty()) {
+		return primary->Lease();
+	}
+
+	Pool& replica = *replicas[nextReplica.fetch_add(1, std::memory_order_relaxed) % replicas.size()];
+	uint64_t required = ParseLsn(readToken);
+
+	// the replica was already seen past the client's write, no need to ask it again
+	if (required == 0 || replica.replayedLsn.load(std::memory_order_relaxed) >= required) {
+		replicaReads.fetch_add(1, std::memory_order_relaxed);
+		return replica.Lease();
+	}
+
+	{
+		Connection connection = replica.Lease();
+
+		QueryResult replayed = connection.Execute(Statements::SelectReplayLsn);
+
+		uint64_t lsn = ParseLsn(std::string(replayed.Get(0, 0)));
+		uint64_t seen = replica.replayedLsn.load(std::memory_order_relaxed);
+		while (lsn > seen && !replica.replayedLsn.compare_exchange_weak(seen, lsn, std::memory_order_relaxed)) {}
+
+		if (lsn >= required) {
+			replicaReads.fetch_add(1, std::memory_order_relaxed);
+			return connection;
+		}
+	}
+
+	primaryFallbacks.fetch_add(1, std::memory_order_relaxed);
+	return primary->Lease();
+}
+
+std::string Database::ReadToken() {
+	if (replicas.empty()) {
+		return "";
+	}
+
+	std::unique_lock<std::mutex> lock(tokenMutex);
+
+	// a query already running may have read the LSN before this caller's write committed, so only one
+	// started from now on covers it; every writer waiting meanwhile shares that one query
+	uint64_t ticket = tokenFetchesStarted + 1;
+
+	while (tokenFetchesFinished < ticket) {
+		if (tokenFetching) {
+			tokenFetched.wait(lock);
+			continue;
+		}
+
+		tokenFetching = true;
+		++tokenFetchesStarted;
+		lock.unlock();
+
+		std::string lsn;
+		try {
+			Connection connection = primary->Lease();
+			*connection << "SELECT pg_current_wal_lsn()::text", soci::into(lsn);
+		}
+		catch (...) {
+			lock.lock();
+			// give the ticket back so a waiting writer tries again
+			--tokenFetchesStarted;
+			tokenFetching = false;
+			tokenFetched.notify_all();
+			throw;
+		}
+
+		lock.lock();
+		latestToken = std::move(lsn);
+		++tokenFetchesFinished;
+		tokenFetching = false;
+		tokenFetched.notify_all();
+	}
+
+	return latestToken;
+}
+
+void Database::PrepareStatements(soci::session& session) {
+	Statements::PrepareAll(Native(session));
+}
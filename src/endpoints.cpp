@@ -1,71 +1,102 @@
 #include "../include/endpoints.hpp"
 
-std::variant<TokenError, json> ValidateToken(std::string& token) {
-	// remove "Bearer "
-	token.erase(0, 7);
+std::optional<int> ParseId(const std::string& value) {
+	int id = 0;
+	auto [end, error] = std::from_chars(value.data(), value.data() + value.size(), id);
 
-	if (token.empty()) {
-		return TokenError{ CppHttp::Net::ResponseType::NOT_AUTHORIZED, "Missing token" };
+	if (error != std::errc() || end != value.data() + value.size()) {
+		return std::nullopt;
 	}
 
-	std::string rsaSecret = std::getenv("RSASECRET");
+	return id;
+}
 
-	size_t pos = 0;
+std::optional<Timestamp> ParseDueDate(const std::string& value) {
+	std::optional<Timestamp> dueDate = Timestamp::Parse(value);
 
-	while ((pos = rsaSecret.find("\\n", pos)) != std::string::npos) {
-		rsaSecret.replace(pos, 2, "\n");
+	if (!dueDate.has_value()) {
+		dueDate = Timestamp::ParseIso(value);
 	}
 
-	jwt::verifier<jwt::default_clock, jwt::traits::nlohmann_json> verifier = jwt::verify<jwt::traits::nlohmann_json>().allow_algorithm(jwt::algorithm::rs512{ "", rsaSecret, "", "" }).with_issuer("auth0");
-	auto decodedToken = jwt::decode<jwt::traits::nlohmann_json>(token);
+	return dueDate;
+}
 
-	std::error_code ec;
-	verifier.verify(decodedToken, ec);
+std::optional<std::vector<std::string>> ReadTokenHeader() {
+	std::string token = Database::GetInstance()->ReadToken();
 
-	if (ec) {
-		std::osyncstream(std::cout) << "\033[1;31m[-] Error: " << ec.message() << "\033[0m\n";
-		return TokenError{ CppHttp::Net::ResponseType::NOT_AUTHORIZED, ec.message() };
+	if (token.empty()) {
+		return std::nullopt;
 	}
 
-	auto tokenJson = decodedToken.get_payload_json();
+	return std::vector<std::string>{ "X-Read-Token: " + token };
+}
+
+std::optional<Page> ParsePage(CppHttp::Net::Request& req) {
+	static const int defaultLimit = (int)std::max<long long>(1, GetEnvNumber("LISTING_PAGE_SIZE", 50));
+	static const int maxLimit = (int)std::max<long long>(defaultLimit, GetEnvNumber("LISTING_MAX_PAGE_SIZE", 200));
+
+	Page page{ defaultLimit, 0 };
+
+	auto limit = req.m_info.parameters.find("limit");
+	if (limit != req.m_info.parameters.end() && !limit->second.empty()) {
+		std::optional<int> value = ParseId(limit->second);
+		if (!value.has_value() || *value <= 0) {
+			return std::nullopt;
+		}
+		page.limit = std::min(*value, maxLimit);
+	}
 
-	return tokenJson;
+	auto after = req.m_info.parameters.find("after");
+	if (after != req.m_info.parameters.end() && !after->second.empty()) {
+		std::string decoded;
+		try {
+			decoded = jwt::base::decode<jwt::alphabet::base64url>(jwt::base::pad<jwt::alphabet::base64url>(after->second));
+		}
+		catch (std::exception&) {
+			return std::nullopt;
+		}
+
+		// cursors are "id:<last id>", base64url encoded so clients treat them as opaque
+		std::optional<int> value = decoded.starts_with("id:") ? ParseId(decoded.substr(3)) : std::nullopt;
+		if (!value.has_value()) {
+			return std::nullopt;
+		}
+		page.after = *value;
+	}
+
+	return page;
+}
+
+std::optional<std::vector<std::string>> NextCursorHeader(int lastId) {
+	std::string cursor = jwt::base::trim<jwt::alphabet::base64url>(jwt::base::encode<jwt::alphabet::base64url>("id:" + std::to_string(lastId)));
+	return std::vector<std::string>{ "X-Next-Cursor: " + cursor };
 }
 
 #pragma region Assignment Functions
 
-returnType CreateAssignment(CppHttp::Net::Request req) {
+asyncReturnType CreateAssignment(CppHttp::Net::Request& req) {
 	if (req.m_info.parameters["classroom_id"].empty()) {
-		return { CppHttp::Net::ResponseType::BAD_REQUEST, "Missing classroom_id in path parameters", {} };
+		co_return returnType{ CppHttp::Net::ResponseType::BAD_REQUEST, "Missing classroom_id in path parameters", {} };
 	}
 
-	soci::session* sql = Database::GetInstance()->GetSession();
-	std::string token = req.m_info.headers["Authorization"];
+	const Principal& principal = GetPrincipal(req);
 
-	auto tokenResult = ValidateToken(token);
+	std::optional<int> classroomId = ParseId(req.m_info.parameters["classroom_id"]);
 
-	if (std::holds_alternative<TokenError>(tokenResult)) {
-		auto error = std::get<TokenError>(tokenResult);
-		return { error.type, error.message, {} };
+	if (!classroomId.has_value()) {
+		co_return returnType{ CppHttp::Net::ResponseType::BAD_REQUEST, "Invalid classroom_id in path parameters", {} };
 	}
 
-	auto tokenJson = std::get<json>(tokenResult);
-	std::string id = tokenJson["id"];
+	bool member = co_await CppHttp::Net::Offload([&]() {
+		return IsClassroomMember(principal, *classroomId);
+	});
 
-	User user;
-	{
-		std::lock_guard<std::mutex> lock(Database::dbMutex);
-		*sql << "SELECT users.* FROM users LEFT JOIN classroom_users ON classroom_users.user_id=users.id WHERE classroom_users.classroom_id=:classroom_id AND users.id=:user_id", soci::use(req.m_info.parameters["classroom_id"]), soci::use(id), soci::into(user);
+	if (!member) {
+		co_return returnType{ CppHttp::Net::ResponseType::FORBIDDEN, "User is not a member of this classroom", {} };
 	}
 
-	if (user.email.empty()) {
-		return { CppHttp::Net::ResponseType::FORBIDDEN, "User is not a member of this classroom", {} };
-	}
-
-	std::transform(user.role.begin(), user.role.end(), user.role.begin(), ::toupper);
-
-	if (user.role != "TEACHER" && user.role != "ADMIN") {
-		return { CppHttp::Net::ResponseType::FORBIDDEN, "User is not a teacher", {} };
+	if (!principal.IsTeacher()) {
+		co_return returnType{ CppHttp::Net::ResponseType::FORBIDDEN, "User is not a teacher", {} };
 	}
 
 	std::vector<std::unordered_map<std::u8string, std::u8string>> formData;
@@ -88,67 +119,62 @@ returnType CreateAssignment(CppHttp::Net::Request req) {
 	}
 
 	if (title.empty()) {
-		return { CppHttp::Net::ResponseType::BAD_REQUEST, "Missing title in request body", {} };
+		co_return returnType{ CppHttp::Net::ResponseType::BAD_REQUEST, "Missing title in request body", {} };
 	}
 
 	if (dueDate.empty()) {
-		return { CppHttp::Net::ResponseType::BAD_REQUEST, "Missing due date in request body", {} };
+		co_return returnType{ CppHttp::Net::ResponseType::BAD_REQUEST, "Missing due date in request body", {} };
 	}
 
-	std::tm dueDateTm = {};
-
-	std::istringstream iss(dueDate);
-	iss >> std::get_time(&dueDateTm, "%d-%m-%Y %H:%M:%S");
+	std::optional<Timestamp> dueDateTimestamp = ParseDueDate(dueDate);
 
-	if (iss.fail()) {
-		return { CppHttp::Net::ResponseType::BAD_REQUEST, "Invalid due date format", {} };
+	if (!dueDateTimestamp.has_value()) {
+		co_return returnType{ CppHttp::Net::ResponseType::BAD_REQUEST, "Invalid due date format", {} };
 	}
 
 	Assignment assignment;
 	assignment.title = std::move(title);
 	assignment.description = std::move(description);
-	assignment.dueDate = std::move(dueDateTm);
-	assignment.classroomId = std::stoi(req.m_info.parameters["classroom_id"]);
-
-	{
-		std::lock_guard<std::mutex> lock(Database::dbMutex);
-		*sql << "INSERT INTO assignments (title, description, due_date, classroom_id) VALUES (:title, :description, :due_date, :classroom_id) RETURNING *", soci::use(assignment.title), soci::use(assignment.description), soci::use(assignment.dueDate), soci::use(assignment.classroomId), soci::into(assignment);
-	}
+	assignment.dueDate = *dueDateTimestamp;
+	assignment.classroomId = *classroomId;
 
 	Azure::Storage::Blobs::BlobServiceClient* blobServiceClient = Blobs::GetInstance()->GetClient();
 	Azure::Storage::Blobs::BlobContainerClient containerClient = blobServiceClient->GetBlobContainerClient("assignments");
 
 	std::vector<std::string> fileUrls;
-	std::string text;
 	for (auto& entry : formData) {
 		if (entry[u8"filename"].empty()) {
 			continue;
 		}
 
 		Azure::Storage::Blobs::BlockBlobClient blockBlobClient = containerClient.GetBlockBlobClient(RandomCode(18) + '-' + std::string(entry[u8"filename"].begin(), entry[u8"filename"].end()));
-		uint8_t* data = new uint8_t[entry[u8"value"].size()];
-
-		std::memcpy(data, entry[u8"value"].data(), entry[u8"value"].size());
+		const std::u8string& data = entry[u8"value"];
 
-		blockBlobClient.UploadFrom(data, entry[u8"value"].size());
+		co_await CppHttp::Net::Offload([&]() {
+			blockBlobClient.UploadFrom(reinterpret_cast<const uint8_t*>(data.data()), data.size());
+		});
 
 		fileUrls.push_back(blockBlobClient.GetUrl());
-
-		delete[] data;
 	}
 
-	{
-		std::lock_guard<std::mutex> lock(Database::dbMutex);
-		for (auto& url : fileUrls) {
-			*sql << "INSERT INTO assignment_files (assignment_id, link) VALUES (:assignment_id, :link)", soci::use(assignment.id), soci::use(url);
+	co_await UnitOfWork::RunAsync([&](Database::Connection& sql) {
+		sql.Timed("insert_assignment", { { "title", assignment.title }, { "description", assignment.description }, { "classroom_id", assignment.classroomId } }, [&]() {
+			*sql << "INSERT INTO assignments (title, description, due_date, classroom_id) VALUES (:title, :description, :due_date, :classroom_id) RETURNING " + ColumnList<Assignment>(), soci::use(assignment.title), soci::use(assignment.description), soci::use(assignment.dueDate), soci::use(assignment.classroomId), soci::into(assignment);
+			return 1;
+		});
+		if (!fileUrls.empty()) {
+			sql.Execute(Statements::InsertAssignmentFiles, assignment.id, fileUrls);
 		}
-	}
+	});
+	std::optional<std::vector<std::string>> readToken = co_await CppHttp::Net::Offload(ReadTokenHeader);
+
+	Membership::GetInstance()->RememberAssignment(assignment.id, assignment.classroomId);
 
 	json response = {
 		{ "id", assignment.id },
 		{ "title", assignment.title },
 		{ "description", assignment.description },
-		{ "dueDate", dueDate },
+		{ "dueDate", assignment.dueDate.Format() },
 		{ "classroomId", assignment.classroomId },
 		{ "files", json::array() }
 	};
@@ -157,67 +183,90 @@ returnType CreateAssignment(CppHttp::Net::Request req) {
 		response["files"].push_back(std::move(url));
 	}
 
-	return { CppHttp::Net::ResponseType::JSON, response.dump(4), {} };
+	co_return returnType{ CppHttp::Net::ResponseType::JSON, response.dump(4), std::move(readToken) };
 }
 
-returnType GetAllAssignments(CppHttp::Net::Request req) {
+returnType GetAllAssignments(CppHttp::Net::Request& req) {
 	if (req.m_info.parameters["classroom_id"].empty()) {
 		return { CppHttp::Net::ResponseType::BAD_REQUEST, "Missing classroom_id in path parameters", {} };
 	}
 
-	soci::session* sql = Database::GetInstance()->GetSession();
-	std::string token = req.m_info.headers["Authorization"];
+	const Principal& principal = GetPrincipal(req);
 
-	auto tokenResult = ValidateToken(token);
+	std::optional<int> classroomId = ParseId(req.m_info.parameters["classroom_id"]);
 
-	if (std::holds_alternative<TokenError>(tokenResult)) {
-		auto error = std::get<TokenError>(tokenResult);
-		return { error.type, error.message, {} };
+	if (!classroomId.has_value()) {
+		return { CppHttp::Net::ResponseType::BAD_REQUEST, "Invalid classroom_id in path parameters", {} };
 	}
 
-	auto tokenJson = std::get<json>(tokenResult);
-	std::string id = tokenJson["id"];
-
-	User user;
-	{
-		std::lock_guard<std::mutex> lock(Database::dbMutex);
-		*sql << "SELECT users.* FROM users LEFT JOIN classroom_users ON classroom_users.user_id=users.id WHERE classroom_users.classroom_id=:classroom_id AND users.id=:user_id", soci::use(req.m_info.parameters["classroom_id"]), soci::use(id), soci::into(user);
+	if (!IsClassroomMember(principal, *classroomId)) {
+		return { CppHttp::Net::ResponseType::FORBIDDEN, "User is not a member of this classroom", {} };
 	}
 
-	if (user.email.empty()) {
-		return { CppHttp::Net::ResponseType::FORBIDDEN, "User is not a member of this classroom", {} };
+	std::optional<Page> page = ParsePage(req);
+
+	if (!page.has_value()) {
+		return { CppHttp::Net::ResponseType::BAD_REQUEST, "Invalid limit or after in query parameters", {} };
 	}
 
 	json response = json::array();
+	std::optional<std::vector<std::string>> nextCursor;
 	{
-		std::lock_guard<std::mutex> lock(Database::dbMutex);
-		soci::rowset<Assignment> rs = (sql->prepare << "SELECT * FROM assignments WHERE classroom_id=:classroom_id", soci::use(req.m_info.parameters["classroom_id"]));
-		soci::rowset<Submission> rs2 = (sql->prepare << "SELECT submissions.* FROM submissions LEFT JOIN assignments ON assignments.id = submissions.assignment_id LEFT JOIN classrooms ON classrooms.id=assignments.classroom_id WHERE submissions.user_id=:user_id AND classrooms.id=:classroom_id", soci::use(id), soci::use(req.m_info.parameters["classroom_id"]));
-		soci::rowset<Grade> rs3 = (sql->prepare << "SELECT * FROM assignment_grades WHERE user_id=:user_id", soci::use(id));
+		ReadSnapshot snapshot(req.m_info.headers["X-Read-Token"]);
+		Database::Connection& sql = snapshot.Connection();
+
+		// one row more than the page holds tells whether there is a next page
+		int fetch = page->limit + 1;
+		std::vector<Assignment> assignments;
+		sql.Timed("select_assignment_page", { { "classroom_id", *classroomId }, { "after", page->after }, { "fetch", fetch } }, [&]() {
+			soci::rowset<Assignment> rs = (sql->prepare << "SELECT " + ColumnList<Assignment>() + " FROM assignments WHERE classroom_id=:classroom_id AND id>:after ORDER BY id LIMIT :fetch", soci::use(*classroomId), soci::use(page->after), soci::use(fetch));
+			std::move(rs.begin(), rs.end(), std::back_inserter(assignments));
+			return assignments.size();
+		});
+
+		if ((int)assignments.size() > page->limit) {
+			assignments.pop_back();
+			nextCursor = NextCursorHeader(assignments.back().id);
+		}
+
+		std::vector<int> assignmentIds;
+		for (auto& assignment : assignments) {
+			assignmentIds.push_back(assignment.id);
+		}
+		std::string pageIds = ToArrayLiteral(assignmentIds);
 
 		std::vector<Submission> submissions;
-		std::move(rs2.begin(), rs2.end(), std::back_inserter(submissions));
+		sql.Timed("select_submissions_of_user", { { "user_id", principal.id }, { "ids", pageIds } }, [&]() {
+			soci::rowset<Submission> rs2 = (sql->prepare << "SELECT " + ColumnList<Submission>() + " FROM submissions WHERE user_id=:user_id AND assignment_id = ANY(CAST(:ids AS int[]))", soci::use(principal.id), soci::use(pageIds));
+			std::move(rs2.begin(), rs2.end(), std::back_inserter(submissions));
+			return submissions.size();
+		});
+
 		std::vector<Grade> grades;
-		std::move(rs3.begin(), rs3.end(), std::back_inserter(grades));
+		sql.Timed("select_grades_of_user", { { "user_id", principal.id }, { "ids", pageIds } }, [&]() {
+			soci::rowset<Grade> rs3 = (sql->prepare << "SELECT " + ColumnList<Grade>() + " FROM assignment_grades WHERE user_id=:user_id AND assignment_id = ANY(CAST(:ids AS int[]))", soci::use(principal.id), soci::use(pageIds));
+			std::move(rs3.begin(), rs3.end(), std::back_inserter(grades));
+			return grades.size();
+		});
 
-		for (auto& assignment : rs) {
-			auto submissionIt = std::find_if(submissions.begin(), submissions.end(), [&assignment](Submission& submission) { return submission.assignmentId == assignment.id; });
-			auto gradeIt = std::find_if(grades.begin(), grades.end(), [&assignment](Grade& grade) { return assignment.id == grade.assignmentId; });
+		GroupIndex<Submission> submissionsByAssignment(submissions, [](const Submission& submission) { return submission.assignmentId; });
+		GroupIndex<Grade> gradesByAssignment(grades, [](const Grade& grade) { return grade.assignmentId; });
+
+		for (auto& assignment : assignments) {
+			const Grade* grade = gradesByAssignment.First(assignment.id);
 
 			json assignmentJson;
 			assignmentJson["id"] = assignment.id;
 			assignmentJson["title"] = assignment.title;
 			assignmentJson["description"] = assignment.description;
-			std::ostringstream oss;
-			oss << std::put_time(&assignment.dueDate, "%d-%m-%Y %H:%M:%S");
-			assignmentJson["dueDate"] = std::move(oss.str());
-			assignmentJson["completed"] = (submissionIt != std::end(submissions));
+			assignmentJson["dueDate"] = assignment.dueDate.Format();
+			assignmentJson["completed"] = (submissionsByAssignment.First(assignment.id) != nullptr);
 
-			if (gradeIt != std::end(grades)) {
+			if (grade != nullptr) {
 				assignmentJson["grade"] = {
-					{ "id", gradeIt->id },
-					{ "grade", gradeIt->grade },
-					{ "feedback", gradeIt->feedback }
+					{ "id", grade->id },
+					{ "grade", grade->grade },
+					{ "feedback", grade->feedback }
 				};
 			}
 
@@ -225,172 +274,92 @@ returnType GetAllAssignments(CppHttp::Net::Request req) {
 		}
 	}
 
-	return { CppHttp::Net::ResponseType::JSON, response.dump(4), {}};
+	return { CppHttp::Net::ResponseType::JSON, response.dump(4), std::move(nextCursor) };
 }
 
-returnType GetAssignment(CppHttp::Net::Request req) {
+asyncReturnType GetAssignment(CppHttp::Net::Request& req) {
 	if (req.m_info.parameters["assignment_id"].empty()) {
-		return { CppHttp::Net::ResponseType::BAD_REQUEST, "Missing classroom_id in path parameters", {} };
+		co_return returnType{ CppHttp::Net::ResponseType::BAD_REQUEST, "Missing classroom_id in path parameters", {} };
 	}
 
-	soci::session* sql = Database::GetInstance()->GetSession();
-	std::string token = req.m_info.headers["Authorization"];
-
-	auto tokenResult = ValidateToken(token);
-
-	if (std::holds_alternative<TokenError>(tokenResult)) {
-		auto error = std::get<TokenError>(tokenResult);
-		return { error.type, error.message, {} };
-	}
-
-	auto tokenJson = std::get<json>(tokenResult);
-	std::string id = tokenJson["id"];
-
-	User user;
-	{
-		std::lock_guard<std::mutex> lock(Database::dbMutex);
-		*sql << "SELECT * FROM users WHERE id=:user_id", soci::use(id), soci::into(user);
-	}
-
-	if (user.email.empty()) {
-		return { CppHttp::Net::ResponseType::FORBIDDEN, "User is not a member of this classroom", {} };
-	}
+	const Principal& principal = GetPrincipal(req);
 
-	Assignment assignment;
-	{
-		std::lock_guard<std::mutex> lock(Database::dbMutex);
-		*sql << "SELECT * FROM assignments WHERE id=:id", soci::use(req.m_info.parameters["assignment_id"]), soci::into(assignment);
-		*sql << "SELECT * FROM classroom_users WHERE classroom_id=:classroom_id AND user_id=:user_id", soci::use(assignment.classroomId), soci::use(id);
+	std::optional<int> assignmentId = ParseId(req.m_info.parameters["assignment_id"]);
 
-		if (!sql->got_data()) {
-			return { CppHttp::Net::ResponseType::FORBIDDEN, "User is not a member of this classroom", {} };
-		}
+	if (!assignmentId.has_value()) {
+		co_return returnType{ CppHttp::Net::ResponseType::NOT_FOUND, "Assignment not found", {} };
 	}
 
-	std::vector<Submission> submissions;
-	std::vector<FileSubmission> fileSubmissions;
-	std::vector<FileAssignment> fileAssignments;
+	// the whole response document is built by the database in one round trip, awaited without holding a thread;
+	// on a replica that has replayed the client's last write, like the other reads
+	int classroomId = 0;
+	std::string document;
 	{
-		std::lock_guard<std::mutex> lock(Database::dbMutex);
-		soci::rowset<Submission> rs = (sql->prepare << "SELECT * FROM submissions WHERE assignment_id=:assignment_id AND user_id=:user_id", soci::use(assignment.id), soci::use(id));
-		std::move(rs.begin(), rs.end(), std::back_inserter(submissions));
-
-		soci::rowset<FileSubmission> rs2 = (sql->prepare << "SELECT file_submissions.* FROM file_submissions LEFT JOIN submissions ON file_submissions.submission_id=submissions.id WHERE submissions.assignment_id=:assignment_id AND submissions.user_id=:user_id", soci::use(assignment.id), soci::use(id));
-		std::move(rs2.begin(), rs2.end(), std::back_inserter(fileSubmissions));
+		QueryResult result = co_await AsyncDatabase::GetInstance()->ExecuteForRead(req.m_info.headers["X-Read-Token"], Statements::SelectAssignmentDocument, *assignmentId, principal.id);
 
-		soci::rowset<FileAssignment> rs3 = (sql->prepare << "SELECT * FROM assignment_files WHERE assignment_id=:assignment_id", soci::use(assignment.id));
-		std::move(rs3.begin(), rs3.end(), std::back_inserter(fileAssignments));
-	}
-
-	std::ostringstream oss;
-	oss << std::put_time(&assignment.dueDate, "%d-%m-%Y %H:%M:%S");
-	
-	bool hasGrade = false;
-	Grade grade;
-	{
-		std::lock_guard<std::mutex> lock(Database::dbMutex);
-		*sql << "SELECT * FROM assignment_grades WHERE assignment_id=:assignment_id AND user_id=:user_id", soci::use(assignment.id), soci::use(id), soci::into(grade);
-		if (sql->got_data()) {
-			hasGrade = true;
+		if (result.Rows() == 0) {
+			co_return returnType{ CppHttp::Net::ResponseType::NOT_FOUND, "Assignment not found", {} };
 		}
-	}
-
-	json response = {
-		{ "id", assignment.id },
-		{ "title", assignment.title },
-		{ "description", assignment.description },
-		{ "dueDate", std::move(oss.str()) },
-		{ "classroomId", assignment.classroomId },
-		{ "files", json::array() },
-		{ "submissions", json::array() }
-	};
 
-	if (hasGrade) {
-		response["grade"] = {
-			{ "id", grade.id },
-			{ "grade", grade.grade },
-			{ "feedback", grade.feedback }
-		};
+		classroomId = result.GetInt(0, 0);
+		document = result.Get(0, 1);
 	}
 
-	for (auto& submission : submissions) {
-		json submissionJson = {
-			{ "id", submission.id },
-			{ "text", submission.text },
-			{ "file_links", json::array() }
-		};
-
-		for (auto& fileSubmission : fileSubmissions) {
-			if (fileSubmission.submissionId == submission.id) {
-				submissionJson["file_links"].push_back(fileSubmission.link);
-			}
-		}
+	Membership::GetInstance()->RememberAssignment(*assignmentId, classroomId);
 
-		response["submissions"].push_back(submissionJson);
-	}
-
-	for (auto& file : fileAssignments) {
-		response["files"].push_back(file.link);
+	if (!IsClassroomMember(principal, classroomId)) {
+		co_return returnType{ CppHttp::Net::ResponseType::FORBIDDEN, "User is not a member of this classroom", {} };
 	}
 
-	return { CppHttp::Net::ResponseType::JSON, response.dump(4), {} };
+	co_return returnType{ CppHttp::Net::ResponseType::JSON, std::move(document), {} };
 }
 
-returnType EditAssignment(CppHttp::Net::Request req) {
+asyncReturnType EditAssignment(CppHttp::Net::Request& req) {
 	if (req.m_info.parameters["assignment_id"].empty()) {
-		return { CppHttp::Net::ResponseType::BAD_REQUEST, "Missing classroom_id in path parameters", {} };
-	}
-
-	soci::session* sql = Database::GetInstance()->GetSession();
-	std::string token = req.m_info.headers["Authorization"];
-
-	auto tokenResult = ValidateToken(token);
-
-	if (std::holds_alternative<TokenError>(tokenResult)) {
-		auto error = std::get<TokenError>(tokenResult);
-		return { error.type, error.message, {} };
+		co_return returnType{ CppHttp::Net::ResponseType::BAD_REQUEST, "Missing classroom_id in path parameters", {} };
 	}
 
-	auto tokenJson = std::get<json>(tokenResult);
-	std::string id = tokenJson["id"];
+	const Principal& principal = GetPrincipal(req);
 
-	User user;
-	{
-		std::lock_guard<std::mutex> lock(Database::dbMutex);
-		*sql << "SELECT * FROM users WHERE id=:user_id", soci::use(id), soci::into(user);
-	}
-
-	if (user.email.empty()) {
-		return { CppHttp::Net::ResponseType::FORBIDDEN, "User is not a member of this classroom", {} };
+	if (!principal.IsTeacher()) {
+		co_return returnType{ CppHttp::Net::ResponseType::FORBIDDEN, "User is not a teacher", {} };
 	}
 
-	std::transform(user.role.begin(), user.role.end(), user.role.begin(), ::toupper);
-
-	if (user.role != "TEACHER" && user.role != "ADMIN") {
-		return { CppHttp::Net::ResponseType::FORBIDDEN, "User is not a teacher", {} };
-	}
+	std::string assignmentId = req.m_info.parameters["assignment_id"];
 
 	Assignment assignment;
-	{
-		std::lock_guard<std::mutex> lock(Database::dbMutex);
-		*sql << "SELECT * FROM assignments WHERE id=:id", soci::use(req.m_info.parameters["assignment_id"]), soci::into(assignment);
-
-		if (assignment.title.empty()) {
-			return { CppHttp::Net::ResponseType::NOT_FOUND, "Assignment not found", {} };
+	std::vector<FileAssignment> files;
+	std::optional<returnType> error = co_await CppHttp::Net::Offload([&]() -> std::optional<returnType> {
+		{
+			Database::Connection sql = Database::GetInstance()->Lease();
+			sql.Timed("select_assignment", { { "assignment_id", assignmentId } }, [&]() {
+				*sql << "SELECT " + ColumnList<Assignment>() + " FROM assignments WHERE id=:id", soci::use(assignmentId), soci::into(assignment);
+				return sql->got_data();
+			});
+
+			if (assignment.title.empty()) {
+				return returnType{ CppHttp::Net::ResponseType::NOT_FOUND, "Assignment not found", {} };
+			}
 		}
 
-		*sql << "SELECT * FROM classroom_users WHERE classroom_id=:classroom_id AND user_id=:user_id", soci::use(assignment.classroomId), soci::use(id);
+		Membership::GetInstance()->RememberAssignment(assignment.id, assignment.classroomId);
 
-		if (!sql->got_data()) {
-			return { CppHttp::Net::ResponseType::FORBIDDEN, "User is not a member of this classroom", {} };
+		if (!IsClassroomMember(principal, assignment.classroomId)) {
+			return returnType{ CppHttp::Net::ResponseType::FORBIDDEN, "User is not a member of this classroom", {} };
 		}
-	}
 
-	std::vector<FileAssignment> files;
-	{
-		std::lock_guard<std::mutex> lock(Database::dbMutex);
-		soci::rowset<FileAssignment> rs = (sql->prepare << "SELECT * FROM assignment_files WHERE assignment_id=:assignment_id", soci::use(assignment.id));
-		std::move(rs.begin(), rs.end(), std::back_inserter(files));
+		Database::Connection sql = Database::GetInstance()->Lease();
+		sql.Timed("select_assignment_files", { { "assignment_id", assignment.id } }, [&]() {
+			soci::rowset<FileAssignment> rs = (sql->prepare << "SELECT " + ColumnList<FileAssignment>() + " FROM assignment_files WHERE assignment_id=:assignment_id", soci::use(assignment.id));
+			std::move(rs.begin(), rs.end(), std::back_inserter(files));
+			return files.size();
+		});
+
+		return std::nullopt;
+	});
+
+	if (error.has_value()) {
+		co_return std::move(*error);
 	}
 
 	std::vector<std::unordered_map<std::u8string, std::u8string>> formData;
@@ -418,37 +387,31 @@ returnType EditAssignment(CppHttp::Net::Request req) {
 
 	if (!title.empty()) {
 		if (title.size() > 120) {
-			return { CppHttp::Net::ResponseType::BAD_REQUEST, "Title is too long", {} };
+			co_return returnType{ CppHttp::Net::ResponseType::BAD_REQUEST, "Title is too long", {} };
 		}
 		assignment.title = std::move(title);
 	}
 	if (!description.empty()) {
 		if (description.size() > 2048) {
-			return { CppHttp::Net::ResponseType::BAD_REQUEST, "Description is too long", {} };
+			co_return returnType{ CppHttp::Net::ResponseType::BAD_REQUEST, "Description is too long", {} };
 		}
 		assignment.description = std::move(description);
 	}
 	if (!dueDate.empty()) {
-		std::tm dueDateTm = {};
+		std::optional<Timestamp> dueDateTimestamp = ParseDueDate(dueDate);
 
-		std::istringstream iss(dueDate);
-		iss >> std::get_time(&dueDateTm, "%d-%m-%Y %H:%M:%S");
-
-		if (iss.fail()) {
-			return { CppHttp::Net::ResponseType::BAD_REQUEST, "Invalid due date format", {} };
+		if (!dueDateTimestamp.has_value()) {
+			co_return returnType{ CppHttp::Net::ResponseType::BAD_REQUEST, "Invalid due date format", {} };
 		}
 
-		assignment.dueDate = std::move(dueDateTm);
+		assignment.dueDate = *dueDateTimestamp;
 	}
 
-	Azure::Storage::Blobs::BlobServiceClient* blobServiceClient = Blobs::GetInstance()->GetClient();
-	Azure::Storage::Blobs::BlobContainerClient containerClient = blobServiceClient->GetBlobContainerClient("assignments");
+	// files the edit no longer lists; every file when no links are sent
+	std::vector<FileAssignment> deletedFiles;
 	if (!links.empty()) {
 		std::vector<std::string> fileLinks = CppHttp::Utils::Split(links, '\n');
 
-		// find deleted files
-		std::vector<FileAssignment> deletedFiles;
-		
 		for (auto& file : files) {
 			auto it = std::find_if(fileLinks.begin(), fileLinks.end(), [&file](std::string& link) { return link == file.link; });
 
@@ -456,36 +419,14 @@ returnType EditAssignment(CppHttp::Net::Request req) {
 				deletedFiles.push_back(file);
 			}
 		}
-
-		// remove deleted files from database
-		{
-			std::lock_guard<std::mutex> lock(Database::dbMutex);
-			for (auto& file : deletedFiles) {
-				*sql << "DELETE FROM assignment_files WHERE id=:id", soci::use(file.id);
-			}
-		}
-			
-		for (auto& file : deletedFiles) {
-			auto toDelete = CppHttp::Utils::Split(file.link, '/');
-			Azure::Storage::Blobs::BlockBlobClient blockBlobClient = containerClient.GetBlockBlobClient(toDelete[toDelete.size() - 1]);
-			blockBlobClient.DeleteIfExists();
-		}
 	}
 	else {
-		{
-			std::lock_guard<std::mutex> lock(Database::dbMutex);
-			for (auto& file : files) {
-				*sql << "DELETE FROM assignment_files WHERE id=:id", soci::use(file.id);
-			}
-		}
-
-		for (auto& file : files) {
-			auto toDelete = CppHttp::Utils::Split(file.link, '/');
-			Azure::Storage::Blobs::BlockBlobClient blockBlobClient = containerClient.GetBlockBlobClient(toDelete[toDelete.size() - 1]);
-			blockBlobClient.DeleteIfExists();
-		}
+		deletedFiles = files;
 	}
 
+	Azure::Storage::Blobs::BlobServiceClient* blobServiceClient = Blobs::GetInstance()->GetClient();
+	Azure::Storage::Blobs::BlobContainerClient containerClient = blobServiceClient->GetBlobContainerClient("assignments");
+
 	std::vector<std::string> fileUrls;
 	for (auto& entry : formData) {
 		if (entry[u8"filename"].empty()) {
@@ -493,38 +434,59 @@ returnType EditAssignment(CppHttp::Net::Request req) {
 		}
 
 		Azure::Storage::Blobs::BlockBlobClient blockBlobClient = containerClient.GetBlockBlobClient(RandomCode(18) + '-' + std::string(entry[u8"filename"].begin(), entry[u8"filename"].end()));
-		uint8_t* data = new uint8_t[entry[u8"value"].size()];
+		const std::u8string& data = entry[u8"value"];
 
-		std::memcpy(data, entry[u8"value"].data(), entry[u8"value"].size());
-
-		blockBlobClient.UploadFrom(data, entry[u8"value"].size());
+		co_await CppHttp::Net::Offload([&]() {
+			blockBlobClient.UploadFrom(reinterpret_cast<const uint8_t*>(data.data()), data.size());
+		});
 
 		fileUrls.push_back(blockBlobClient.GetUrl());
-
-		delete[] data;
 	}
 
-	{
-		std::lock_guard<std::mutex> lock(Database::dbMutex);
-		for (auto& url : fileUrls) {
-			*sql << "INSERT INTO assignment_files (assignment_id, link) VALUES (:assignment_id, :link)", soci::use(assignment.id), soci::use(url);
+	// the file rows and the assignment change together, a failed upload or update leaves the old files in place
+	co_await UnitOfWork::RunAsync([&](Database::Connection& sql) {
+		if (!deletedFiles.empty()) {
+			std::vector<int> ids;
+			for (auto& file : deletedFiles) {
+				ids.push_back(file.id);
+			}
+
+			sql.Execute(Statements::DeleteAssignmentFiles, ids);
 		}
 
-		soci::rowset<FileAssignment> rs = (sql->prepare << "SELECT * FROM assignment_files WHERE assignment_id=:assignment_id", soci::use(assignment.id));
-		files.clear();
-		std::move(rs.begin(), rs.end(), std::back_inserter(files));
-	}
+		if (!fileUrls.empty()) {
+			sql.Execute(Statements::InsertAssignmentFiles, assignment.id, fileUrls);
+		}
 
-	{
-		std::lock_guard<std::mutex> lock(Database::dbMutex);
-		*sql << "UPDATE assignments SET title=:title, description=:description, due_date=:due_date WHERE id=:id RETURNING *", soci::use(assignment.title), soci::use(assignment.description), soci::use(assignment.dueDate), soci::use(req.m_info.parameters["assignment_id"]), soci::into(assignment);
-	}
+		sql.Timed("update_assignment", { { "title", assignment.title }, { "description", assignment.description }, { "assignment_id", assignment.id } }, [&]() {
+			*sql << "UPDATE assignments SET title=:title, description=:description, due_date=:due_date WHERE id=:id RETURNING " + ColumnList<Assignment>(), soci::use(assignment.title), soci::use(assignment.description), soci::use(assignment.dueDate), soci::use(assignment.id), soci::into(assignment);
+			return sql->got_data();
+		});
+
+		sql.Timed("select_assignment_files", { { "assignment_id", assignment.id } }, [&]() {
+			soci::rowset<FileAssignment> rs = (sql->prepare << "SELECT " + ColumnList<FileAssignment>() + " FROM assignment_files WHERE assignment_id=:assignment_id", soci::use(assignment.id));
+			files.clear();
+			std::move(rs.begin(), rs.end(), std::back_inserter(files));
+			return files.size();
+		});
+	});
+
+	// blobs go only once no committed row points at them any more
+	std::optional<std::vector<std::string>> readToken = co_await CppHttp::Net::Offload([&]() {
+		for (auto& file : deletedFiles) {
+			auto toDelete = CppHttp::Utils::Split(file.link, '/');
+			Azure::Storage::Blobs::BlockBlobClient blockBlobClient = containerClient.GetBlockBlobClient(toDelete[toDelete.size() - 1]);
+			blockBlobClient.DeleteIfExists();
+		}
+
+		return ReadTokenHeader();
+	});
 
 	json response = {
 		{ "id", assignment.id },
 		{ "title", assignment.title },
 		{ "description", assignment.description },
-		{ "dueDate", dueDate },
+		{ "dueDate", assignment.dueDate.Format() },
 		{ "classroomId", assignment.classroomId },
 		{ "files", json::array() }
 	};
@@ -533,120 +495,95 @@ returnType EditAssignment(CppHttp::Net::Request req) {
 		response["files"].push_back(file.link);
 	}
 
-	return { CppHttp::Net::ResponseType::JSON, response.dump(4), {} };
+	co_return returnType{ CppHttp::Net::ResponseType::JSON, response.dump(4), std::move(readToken) };
 }
 
-returnType DeleteAssignment(CppHttp::Net::Request req) {
+returnType DeleteAssignment(CppHttp::Net::Request& req) {
 	if (req.m_info.parameters["assignment_id"].empty()) {
 		return { CppHttp::Net::ResponseType::BAD_REQUEST, "Missing classroom_id in path parameters", {} };
 	}
 
-	soci::session* sql = Database::GetInstance()->GetSession();
-	std::string token = req.m_info.headers["Authorization"];
-
-	auto tokenResult = ValidateToken(token);
-
-	if (std::holds_alternative<TokenError>(tokenResult)) {
-		auto error = std::get<TokenError>(tokenResult);
-		return { error.type, error.message, {} };
-	}
-
-	auto tokenJson = std::get<json>(tokenResult);
-	std::string id = tokenJson["id"];
-
-	User user;
-	{
-		std::lock_guard<std::mutex> lock(Database::dbMutex);
-		*sql << "SELECT * FROM users WHERE id=:user_id", soci::use(id), soci::into(user);
-	}
+	const Principal& principal = GetPrincipal(req);
 
-	if (user.email.empty()) {
-		return { CppHttp::Net::ResponseType::FORBIDDEN, "User is not a member of this classroom", {} };
-	}
-
-	std::transform(user.role.begin(), user.role.end(), user.role.begin(), ::toupper);
-
-	if (user.role != "TEACHER" && user.role != "ADMIN") {
+	if (!principal.IsTeacher()) {
 		return { CppHttp::Net::ResponseType::FORBIDDEN, "User is not a teacher", {} };
 	}
 
 	Assignment assignment;
 	{
-		std::lock_guard<std::mutex> lock(Database::dbMutex);
-		*sql << "SELECT * FROM assignments WHERE id=:id", soci::use(req.m_info.parameters["assignment_id"]), soci::into(assignment);
+		Database::Connection sql = Database::GetInstance()->Lease();
+		sql.Timed("select_assignment", { { "assignment_id", req.m_info.parameters["assignment_id"] } }, [&]() {
+			*sql << "SELECT " + ColumnList<Assignment>() + " FROM assignments WHERE id=:id", soci::use(req.m_info.parameters["assignment_id"]), soci::into(assignment);
+			return sql->got_data();
+		});
 
 		if (assignment.title.empty()) {
 			return { CppHttp::Net::ResponseType::NOT_FOUND, "Assignment not found", {} };
 		}
+	}
 
-		*sql << "SELECT * FROM classroom_users WHERE classroom_id=:classroom_id AND user_id=:user_id", soci::use(assignment.classroomId), soci::use(id);
+	Membership::GetInstance()->RememberAssignment(assignment.id, assignment.classroomId);
 
-		if (!sql->got_data()) {
-			return { CppHttp::Net::ResponseType::FORBIDDEN, "User is not a member of this classroom", {} };
-		}
+	if (!IsClassroomMember(principal, assignment.classroomId)) {
+		return { CppHttp::Net::ResponseType::FORBIDDEN, "User is not a member of this classroom", {} };
 	}
 
 	{
-		std::lock_guard<std::mutex> lock(Database::dbMutex);
-		*sql << "DELETE FROM assignments WHERE id=:id", soci::use(req.m_info.parameters["assignment_id"]);
+		Database::Connection sql = Database::GetInstance()->Lease();
+		sql.Timed("delete_assignment", { { "assignment_id", req.m_info.parameters["assignment_id"] } }, [&]() {
+			*sql << "DELETE FROM assignments WHERE id=:id", soci::use(req.m_info.parameters["assignment_id"]);
+			return 0;
+		});
 	}
 
-	return { CppHttp::Net::ResponseType::OK, "Assignment deleted", {} };
+	Membership::GetInstance()->ForgetAssignment(assignment.id);
+
+	return { CppHttp::Net::ResponseType::OK, "Assignment deleted", ReadTokenHeader() };
 }
 
 #pragma endregion
 
 #pragma region Submission Functions
 
-returnType SubmitAssignment(CppHttp::Net::Request req) {
+asyncReturnType SubmitAssignment(CppHttp::Net::Request& req) {
 	if (req.m_info.parameters["assignment_id"].empty()) {
-		return { CppHttp::Net::ResponseType::BAD_REQUEST, "Missing assignment_id in path parameters", {} };
+		co_return returnType{ CppHttp::Net::ResponseType::BAD_REQUEST, "Missing assignment_id in path parameters", {} };
 	}
 
-	soci::session* sql = Database::GetInstance()->GetSession();
-	std::string token = req.m_info.headers["Authorization"];
-
-	auto tokenResult = ValidateToken(token);
-
-	if (std::holds_alternative<TokenError>(tokenResult)) {
-		auto error = std::get<TokenError>(tokenResult);
-		return { error.type, error.message, {} };
-	}
-
-	auto tokenJson = std::get<json>(tokenResult);
-	std::string id = tokenJson["id"];
-
-	User user;
-	{
-		std::lock_guard<std::mutex> lock(Database::dbMutex);
-		*sql << "SELECT * FROM users WHERE id=:user_id", soci::use(id), soci::into(user);
-	}
-
-	if (user.email.empty()) {
-		return { CppHttp::Net::ResponseType::NOT_AUTHORIZED, "Not authorized", {} };
-	}
+	const Principal& principal = GetPrincipal(req);
 
 	std::string assignmentId = req.m_info.parameters["assignment_id"];
 
 	Assignment assignment;
-	{
-		std::lock_guard<std::mutex> lock(Database::dbMutex);
-
-		*sql << "SELECT * FROM assignments WHERE id=:id", soci::use(assignmentId), soci::into(assignment);
-		if (assignment.title.empty()) {
-			return { CppHttp::Net::ResponseType::NOT_FOUND, "Assignment not found", {} };
+	std::optional<returnType> error = co_await CppHttp::Net::Offload([&]() -> std::optional<returnType> {
+		{
+			Database::Connection sql = Database::GetInstance()->Lease();
+
+			sql.Timed("select_assignment", { { "assignment_id", assignmentId } }, [&]() {
+				*sql << "SELECT " + ColumnList<Assignment>() + " FROM assignments WHERE id=:id", soci::use(assignmentId), soci::into(assignment);
+				return sql->got_data();
+			});
+			if (assignment.title.empty()) {
+				return returnType{ CppHttp::Net::ResponseType::NOT_FOUND, "Assignment not found", {} };
+			}
 		}
-	
-		*sql << "SELECT * FROM classroom_users WHERE classroom_id=:classroom_id AND user_id=:user_id", soci::use(assignment.classroomId), soci::use(id);
-		if (!sql->got_data()) {
-			return { CppHttp::Net::ResponseType::FORBIDDEN, "User is not a member of this classroom", {} };
+
+		Membership::GetInstance()->RememberAssignment(assignment.id, assignment.classroomId);
+
+		if (!IsClassroomMember(principal, assignment.classroomId)) {
+			return returnType{ CppHttp::Net::ResponseType::FORBIDDEN, "User is not a member of this classroom", {} };
 		}
+
+		return std::nullopt;
+	});
+
+	if (error.has_value()) {
+		co_return std::move(*error);
 	}
 
 	// check if date is past due
-	std::time_t now = std::time(nullptr);
-	if (std::mktime(&assignment.dueDate) < now) {
-		return { CppHttp::Net::ResponseType::BAD_REQUEST, "Assignment is past due", {} };
+	if (assignment.dueDate < Timestamp::Now()) {
+		co_return returnType{ CppHttp::Net::ResponseType::BAD_REQUEST, "Assignment is past due", {} };
 	}
 
 	std::vector<std::unordered_map<std::u8string, std::u8string>> formData;
@@ -667,32 +604,35 @@ returnType SubmitAssignment(CppHttp::Net::Request req) {
 		}
 
 		Azure::Storage::Blobs::BlockBlobClient blockBlobClient = containerClient.GetBlockBlobClient(RandomCode(18) + '-' + std::string(entry[u8"filename"].begin(), entry[u8"filename"].end()));
-		uint8_t* data = new uint8_t[entry[u8"value"].size()];
+		const std::u8string& data = entry[u8"value"];
 
-		std::memcpy(data, entry[u8"value"].data(), entry[u8"value"].size());
-
-		blockBlobClient.UploadFrom(data, entry[u8"value"].size());
+		co_await CppHttp::Net::Offload([&]() {
+			blockBlobClient.UploadFrom(reinterpret_cast<const uint8_t*>(data.data()), data.size());
+		});
 
 		fileUrls.push_back(blockBlobClient.GetUrl());
-
-		delete[] data;
 	}
 
 	if (text.empty() && fileUrls.empty()) {
-		return { CppHttp::Net::ResponseType::BAD_REQUEST, "Submission is empty", {} };
+		co_return returnType{ CppHttp::Net::ResponseType::BAD_REQUEST, "Submission is empty", {} };
 	}
 
 	Submission submission;
 	submission.assignmentId = std::stoi(assignmentId);
-	submission.userId = std::stoi(id);
+	submission.userId = principal.id;
 	submission.text = std::move(text);
-	{
-		std::lock_guard<std::mutex> lock(Database::dbMutex);
-		*sql << "INSERT INTO submissions (assignment_id, user_id, text) VALUES (:assignment_id, :user_id, :text) RETURNING *", soci::use(submission.assignmentId), soci::use(submission.userId), soci::use(submission.text), soci::into(submission);
-		for (auto& url : fileUrls) {
-			*sql << "INSERT INTO file_submissions (submission_id, link) VALUES (:submission_id, :link)", soci::use(submission.id), soci::use(url);
+	co_await UnitOfWork::RunAsync([&](Database::Connection& sql) {
+		sql.Timed("insert_submission", { { "assignment_id", submission.assignmentId }, { "user_id", submission.userId }, { "text", submission.text } }, [&]() {
+			*sql << "INSERT INTO submissions (assignment_id, user_id, text) VALUES (:assignment_id, :user_id, :text) RETURNING " + ColumnList<Submission>(), soci::use(submission.assignmentId), soci::use(submission.userId), soci::use(submission.text), soci::into(submission);
+			return 1;
+		});
+		if (!fileUrls.empty()) {
+			sql.Execute(Statements::InsertSubmissionFiles, submission.id, fileUrls);
 		}
-	}
+	});
+	std::optional<std::vector<std::string>> readToken = co_await CppHttp::Net::Offload(ReadTokenHeader);
+
+	Membership::GetInstance()->RememberSubmission(submission.id, submission.assignmentId);
 
 	json response = {
 		{ "id", submission.id },
@@ -706,51 +646,47 @@ returnType SubmitAssignment(CppHttp::Net::Request req) {
 		response["files"].push_back(std::move(url));
 	}
 
-	return { CppHttp::Net::ResponseType::JSON, response.dump(4), {} };
+	co_return returnType{ CppHttp::Net::ResponseType::JSON, response.dump(4), std::move(readToken) };
 }
 
-returnType GetAllSubmissions(CppHttp::Net::Request req) {
+returnType GetAllSubmissions(CppHttp::Net::Request& req) {
 	if (req.m_info.parameters["assignment_id"].empty()) {
 		return { CppHttp::Net::ResponseType::BAD_REQUEST, "Missing assignment_id in path parameters", {} };
 	}
 
-	soci::session* sql = Database::GetInstance()->GetSession();
-	std::string token = req.m_info.headers["Authorization"];
+	const Principal& principal = GetPrincipal(req);
 
-	auto tokenResult = ValidateToken(token);
+	std::optional<int> assignmentId = ParseId(req.m_info.parameters["assignment_id"]);
+	std::optional<int> classroomId = assignmentId.has_value() ? Membership::GetInstance()->ClassroomOfAssignment(*assignmentId) : std::nullopt;
 
-	if (std::holds_alternative<TokenError>(tokenResult)) {
-		auto error = std::get<TokenError>(tokenResult);
-		return { error.type, error.message, {} };
+	if (!classroomId.has_value()) {
+		return { CppHttp::Net::ResponseType::NOT_FOUND, "Assignment not found", {} };
 	}
 
-	auto tokenJson = std::get<json>(tokenResult);
-	std::string id = tokenJson["id"];
+	if (!IsClassroomMember(principal, *classroomId)) {
+		return { CppHttp::Net::ResponseType::FORBIDDEN, "User is not a member of this classroom", {} };
+	}
 
-	User user;
-	{
-		std::lock_guard<std::mutex> lock(Database::dbMutex);
-		*sql << "SELECT classroom_users.* FROM classroom_users LEFT JOIN assignments ON assignments.classroom_id=classroom_users.classroom_id WHERE assignments.id=:assignment_id AND classroom_users.user_id=:user_id", soci::use(req.m_info.parameters["assignment_id"]), soci::use(id);
-		
-		if (!sql->got_data()) {
-			return { CppHttp::Net::ResponseType::FORBIDDEN, "User is not a member of this classroom", {} };
-		}
-		*sql << "SELECT * FROM users WHERE id=:user_id", soci::use(id), soci::into(user);
-		if (user.email.empty()) {
-			return { CppHttp::Net::ResponseType::NOT_AUTHORIZED, "Not authorized", {} };
-		}
+	if (!principal.IsTeacher()) {
+		return { CppHttp::Net::ResponseType::FORBIDDEN, "User is not a teacher", {} };
 	}
 
-	std::transform(user.role.begin(), user.role.end(), user.role.begin(), ::toupper);
+	std::optional<Page> page = ParsePage(req);
 
-	if (user.role != "TEACHER" && user.role != "ADMIN") {
-		return { CppHttp::Net::ResponseType::FORBIDDEN, "User is not a teacher", {} };
+	if (!page.has_value()) {
+		return { CppHttp::Net::ResponseType::BAD_REQUEST, "Invalid limit or after in query parameters", {} };
 	}
 
+	// every read below comes from one snapshot, so the page and the files and grades joined to it agree
+	ReadSnapshot snapshot(req.m_info.headers["X-Read-Token"]);
+	Database::Connection& sql = snapshot.Connection();
+
 	Assignment assignment;
 	{
-		std::lock_guard<std::mutex> lock(Database::dbMutex);
-		*sql << "SELECT * FROM assignments WHERE id=:id", soci::use(req.m_info.parameters["assignment_id"]), soci::into(assignment);
+		sql.Timed("select_assignment", { { "assignment_id", req.m_info.parameters["assignment_id"] } }, [&]() {
+			*sql << "SELECT " + ColumnList<Assignment>() + " FROM assignments WHERE id=:id", soci::use(req.m_info.parameters["assignment_id"]), soci::into(assignment);
+			return sql->got_data();
+		});
 	}
 
 	if (assignment.title.empty()) {
@@ -758,35 +694,54 @@ returnType GetAllSubmissions(CppHttp::Net::Request req) {
 	}
 
 	std::vector<UserSubmissionJoin> submissionJoins = {};
+	std::optional<std::vector<std::string>> nextCursor;
 	{
-		std::lock_guard<std::mutex> lock(Database::dbMutex);
-		soci::rowset<UserSubmissionJoin> rs = (sql->prepare << "SELECT users.first_name, users.last_name, users.email, submissions.id, submissions.user_id FROM users LEFT JOIN submissions ON submissions.user_id=users.id LEFT JOIN assignments ON assignments.id=submissions.assignment_id WHERE assignments.id=:assignment_id", soci::use(req.m_info.parameters["assignment_id"]));
-		std::move(rs.begin(), rs.end(), std::back_inserter(submissionJoins));
+		// one row more than the page holds tells whether there is a next page
+		int fetch = page->limit + 1;
+		sql.Timed("select_submission_page", { { "assignment_id", *assignmentId }, { "after", page->after }, { "fetch", fetch } }, [&]() {
+			soci::rowset<UserSubmissionJoin> rs = (sql->prepare << "SELECT " + ColumnList<UserSubmissionJoin>() + " FROM submissions JOIN users ON users.id=submissions.user_id WHERE submissions.assignment_id=:assignment_id AND submissions.id>:after ORDER BY submissions.id LIMIT :fetch", soci::use(*assignmentId), soci::use(page->after), soci::use(fetch));
+			std::move(rs.begin(), rs.end(), std::back_inserter(submissionJoins));
+			return submissionJoins.size();
+		});
+
+		if ((int)submissionJoins.size() > page->limit) {
+			submissionJoins.pop_back();
+			nextCursor = NextCursorHeader(submissionJoins.back().id);
+		}
 	}
 
-	std::vector<FileSubmission> fileSubmissions = {};
-	{
-		std::lock_guard<std::mutex> lock(Database::dbMutex);
-		soci::rowset<FileSubmission> rs = (sql->prepare << "SELECT file_submissions.* FROM file_submissions LEFT JOIN submissions ON file_submissions.submission_id=submissions.id WHERE submissions.assignment_id=:assignment_id", soci::use(req.m_info.parameters["assignment_id"]));
-		std::move(rs.begin(), rs.end(), std::back_inserter(fileSubmissions));
+	std::vector<int> submissionIds;
+	std::vector<int> userIds;
+	for (auto& submission : submissionJoins) {
+		submissionIds.push_back(submission.id);
+		userIds.push_back(submission.userId);
 	}
+	std::string pageSubmissionIds = ToArrayLiteral(submissionIds);
+	std::string pageUserIds = ToArrayLiteral(userIds);
 
-	std::vector<Submission> submissions = {};
+	std::vector<FileSubmission> fileSubmissions = {};
 	{
-		std::lock_guard<std::mutex> lock(Database::dbMutex);
-		soci::rowset<Submission> rs = (sql->prepare << "SELECT * FROM submissions WHERE assignment_id=:assignment_id", soci::use(req.m_info.parameters["assignment_id"]));
-		std::move(rs.begin(), rs.end(), std::back_inserter(submissions));
+		sql.Timed("select_submission_files", { { "ids", pageSubmissionIds } }, [&]() {
+			soci::rowset<FileSubmission> rs = (sql->prepare << "SELECT " + ColumnList<FileSubmission>() + " FROM file_submissions WHERE submission_id = ANY(CAST(:ids AS int[]))", soci::use(pageSubmissionIds));
+			std::move(rs.begin(), rs.end(), std::back_inserter(fileSubmissions));
+			return fileSubmissions.size();
+		});
 	}
 
 	std::vector<Grade> grades = {};
 	{
-		std::lock_guard<std::mutex> lock(Database::dbMutex);
-		soci::rowset<Grade> rs = (sql->prepare << "SELECT * FROM assignment_grades WHERE assignment_id=:assignment_id", soci::use(req.m_info.parameters["assignment_id"]));
+		sql.Timed("select_grades_of_users", { { "assignment_id", *assignmentId }, { "ids", pageUserIds } }, [&]() {
+			soci::rowset<Grade> rs = (sql->prepare << "SELECT " + ColumnList<Grade>() + " FROM assignment_grades WHERE assignment_id=:assignment_id AND user_id = ANY(CAST(:ids AS int[]))", soci::use(*assignmentId), soci::use(pageUserIds));
 
-		if (rs.begin() != rs.end())
-			std::move(rs.begin(), rs.end(), std::back_inserter(grades));
+			if (rs.begin() != rs.end())
+				std::move(rs.begin(), rs.end(), std::back_inserter(grades));
+			return grades.size();
+		});
 	}
 
+	GroupIndex<FileSubmission> filesBySubmission(fileSubmissions, [](const FileSubmission& file) { return file.submissionId; });
+	GroupIndex<Grade> gradesByUser(grades, [](const Grade& grade) { return grade.userId; });
+
 	json response = json::array();
 
 	for (auto& submission : submissionJoins) {
@@ -797,112 +752,96 @@ returnType GetAllSubmissions(CppHttp::Net::Request req) {
 			{ "email", submission.email }
 		};
 
-		auto submissionIt = std::find_if(submissions.begin(), submissions.end(), [&submission](Submission& sub) { return sub.id == submission.id; });
-		auto fileSubmissionIt = std::find_if(fileSubmissions.begin(), fileSubmissions.end(), [&submission](FileSubmission& fileSubmission) { return fileSubmission.submissionId == submission.id; });
+		std::span<const FileSubmission* const> files = filesBySubmission.All(submission.id);
 
-		if (submissionIt != std::end(submissions)) {
-			submissionJson["submission"] = {};
-			submissionJson["submission"]["id"] = submissionIt->id;
-			submissionJson["submission"]["text"] = submissionIt->text;
+		submissionJson["submission"] = {};
+		submissionJson["submission"]["id"] = submission.id;
+		submissionJson["submission"]["text"] = submission.text;
 
-			std::ostringstream oss;
-			oss << std::put_time(&submissionIt->submittedAt, "%d-%m-%Y %H:%M:%S");
+		submissionJson["submission"]["submission_time"] = submission.submittedAt.Format();
 
-			submissionJson["submission"]["submission_time"] = std::move(oss.str());
-
-			if (fileSubmissionIt != std::end(fileSubmissions)) {
-				submissionJson["submission"]["files"] = json::array();
-				for (auto& file : fileSubmissions) {
-					submissionJson["submission"]["files"].push_back(file.link);
-				}
+		if (!files.empty()) {
+			submissionJson["submission"]["files"] = json::array();
+			for (const FileSubmission* file : files) {
+				submissionJson["submission"]["files"].push_back(file->link);
 			}
 		}
 
-		auto gradeIt = std::find_if(grades.begin(), grades.end(), [&submission](Grade& grade) { return grade.userId == submission.userId; });
-		if (gradeIt != std::end(grades)) {
+		const Grade* grade = gradesByUser.First(submission.userId);
+		if (grade != nullptr) {
 			submissionJson["grade"] = {
-				{ "id", gradeIt->id },
-				{ "grade", gradeIt->grade },
-				{ "feedback", gradeIt->feedback }
+				{ "id", grade->id },
+				{ "grade", grade->grade },
+				{ "feedback", grade->feedback }
 			};
 		}
 
 		response.push_back(submissionJson);
 	}
 
-	return { CppHttp::Net::ResponseType::JSON, response.dump(4), {}};
+	return { CppHttp::Net::ResponseType::JSON, response.dump(4), std::move(nextCursor) };
 }
 
-returnType DeleteSubmission(CppHttp::Net::Request req) {
+returnType DeleteSubmission(CppHttp::Net::Request& req) {
 	if (req.m_info.parameters["submission_id"].empty()) {
 		return { CppHttp::Net::ResponseType::BAD_REQUEST, "Missing submission_id in path parameters", {} };
 	}
 
-	soci::session* sql = Database::GetInstance()->GetSession();
-	std::string token = req.m_info.headers["Authorization"];
-
-	auto tokenResult = ValidateToken(token);
-
-	if (std::holds_alternative<TokenError>(tokenResult)) {
-		auto error = std::get<TokenError>(tokenResult);
-		return { error.type, error.message, {} };
-	}
-
-	auto tokenJson = std::get<json>(tokenResult);
-	std::string id = tokenJson["id"];
-
-	User user;
-	{
-		std::lock_guard<std::mutex> lock(Database::dbMutex);
-		*sql << "SELECT * FROM users WHERE id=:user_id", soci::use(id), soci::into(user);
-	}
-
-	if (user.email.empty()) {
-		return { CppHttp::Net::ResponseType::FORBIDDEN, "User is not a member of this classroom", {} };
-	}
+	const Principal& principal = GetPrincipal(req);
 
 	Submission submission;
 	{
-		std::lock_guard<std::mutex> lock(Database::dbMutex);
-		*sql << "SELECT * FROM submissions WHERE id=:id", soci::use(req.m_info.parameters["submission_id"]), soci::into(submission);
+		Database::Connection sql = Database::GetInstance()->Lease();
+		sql.Timed("select_submission", { { "submission_id", req.m_info.parameters["submission_id"] } }, [&]() {
+			*sql << "SELECT " + ColumnList<Submission>() + " FROM submissions WHERE id=:id", soci::use(req.m_info.parameters["submission_id"]), soci::into(submission);
+			return sql->got_data();
+		});
 
 		if (submission.text.empty()) {
 			return { CppHttp::Net::ResponseType::NOT_FOUND, "Submission not found", {} };
 		}
+	}
 
-		*sql << "SELECT classroom_users.* FROM classroom_users LEFT JOIN assignments ON assignments.classroom_id=classroom_users.classroom_id LEFT JOIN submissions ON assignments.id=submissions.assignment_id WHERE submissions.id=:submission_id AND classroom_users.user_id=:user_id", soci::use(req.m_info.parameters["submission_id"]), soci::use(id);
+	Membership::GetInstance()->RememberSubmission(submission.id, submission.assignmentId);
 
-		if (!sql->got_data()) {
-			return { CppHttp::Net::ResponseType::FORBIDDEN, "User is not a member of this classroom", {} };
-		}
+	std::optional<int> classroomId = Membership::GetInstance()->ClassroomOfSubmission(submission.id);
+
+	if (!classroomId.has_value() || !IsClassroomMember(principal, *classroomId)) {
+		return { CppHttp::Net::ResponseType::FORBIDDEN, "User is not a member of this classroom", {} };
 	}
 
 	// check if date is past due
 	Assignment assignment;
 	{
-		std::lock_guard<std::mutex> lock(Database::dbMutex);
-		*sql << "SELECT * FROM assignments WHERE id=:id", soci::use(submission.assignmentId), soci::into(assignment);
+		Database::Connection sql = Database::GetInstance()->Lease();
+		sql.Timed("select_assignment", { { "assignment_id", submission.assignmentId } }, [&]() {
+			*sql << "SELECT " + ColumnList<Assignment>() + " FROM assignments WHERE id=:id", soci::use(submission.assignmentId), soci::into(assignment);
+			return sql->got_data();
+		});
 	}
 
-	std::time_t now = std::time(nullptr);
-
-	if (std::mktime(&assignment.dueDate) < now) {
+	if (assignment.dueDate < Timestamp::Now()) {
 		return { CppHttp::Net::ResponseType::BAD_REQUEST, "Assignment is past due", {} };
 	}
 
 	{
-		std::lock_guard<std::mutex> lock(Database::dbMutex);
-		*sql << "DELETE FROM submissions WHERE id=:id", soci::use(req.m_info.parameters["submission_id"]);
+		Database::Connection sql = Database::GetInstance()->Lease();
+		sql.Timed("delete_submission", { { "submission_id", req.m_info.parameters["submission_id"] } }, [&]() {
+			*sql << "DELETE FROM submissions WHERE id=:id", soci::use(req.m_info.parameters["submission_id"]);
+			return 0;
+		});
 	}
 
-	return { CppHttp::Net::ResponseType::OK, "Submission deleted", {} };
+	Membership::GetInstance()->ForgetSubmission(submission.id);
+
+	return { CppHttp::Net::ResponseType::OK, "Submission deleted", ReadTokenHeader() };
 }
 
 #pragma endregion
 
 #pragma region Grade Functions
 
-returnType GradeAssignment(CppHttp::Net::Request req) {
+returnType GradeAssignment(CppHttp::Net::Request& req) {
 	if (req.m_info.parameters["assignment_id"].empty()) {
 		return { CppHttp::Net::ResponseType::BAD_REQUEST, "Missing assignment_id in path parameters", {} };
 	}
@@ -910,44 +849,24 @@ returnType GradeAssignment(CppHttp::Net::Request req) {
 		return { CppHttp::Net::ResponseType::BAD_REQUEST, "Missing user_id in path parameters", {} };
 	}
 
-	soci::session* sql = Database::GetInstance()->GetSession();
-	std::string token = req.m_info.headers["Authorization"];
-
-	auto tokenResult = ValidateToken(token);
+	const Principal& principal = GetPrincipal(req);
 
-	if (std::holds_alternative<TokenError>(tokenResult)) {
-		auto error = std::get<TokenError>(tokenResult);
-		return { error.type, error.message, {} };
+	if (!principal.IsTeacher()) {
+		return { CppHttp::Net::ResponseType::FORBIDDEN, "User is not a teacher", {} };
 	}
 
-	auto tokenJson = std::get<json>(tokenResult);
-	std::string id = tokenJson["id"];
+	std::optional<int> assignmentId = ParseId(req.m_info.parameters["assignment_id"]);
+	std::optional<int> userId = ParseId(req.m_info.parameters["user_id"]);
+	std::optional<int> classroomId = assignmentId.has_value() ? Membership::GetInstance()->ClassroomOfAssignment(*assignmentId) : std::nullopt;
 
-	User user;
-	{
-		std::lock_guard<std::mutex> lock(Database::dbMutex);
-		*sql << "SELECT * FROM users WHERE id=:user_id", soci::use(id), soci::into(user);
+	if (!classroomId.has_value()) {
+		return { CppHttp::Net::ResponseType::NOT_FOUND, "Assignment not found", {} };
 	}
 
-	if (user.email.empty()) {
+	if (!userId.has_value() || !Membership::GetInstance()->IsMember(*classroomId, *userId)) {
 		return { CppHttp::Net::ResponseType::FORBIDDEN, "User is not a member of this classroom", {} };
 	}
 
-	std::transform(user.role.begin(), user.role.end(), user.role.begin(), ::toupper);
-
-	if (user.role != "TEACHER" && user.role != "ADMIN") {
-		return { CppHttp::Net::ResponseType::FORBIDDEN, "User is not a teacher", {} };
-	}
-
-	{
-		std::lock_guard<std::mutex> lock(Database::dbMutex);
-		*sql << "SELECT classroom_users.* FROM classroom_users LEFT JOIN assignments ON classroom_users.classroom_id=assignments.classroom_id WHERE assignments.id=:assignment_id AND classroom_users.user_id=:user_id", soci::use(req.m_info.parameters["assignment_id"]), soci::use(req.m_info.parameters["user_id"]);
-
-		if (!sql->got_data()) {
-			return { CppHttp::Net::ResponseType::FORBIDDEN, "User is not a member of this classroom", {} };
-		}
-	}
-
 	json body;
 	try {
 		body = json::parse(req.m_info.body);
@@ -969,8 +888,11 @@ returnType GradeAssignment(CppHttp::Net::Request req) {
 
 	Assignment assignment;
 	{
-		std::lock_guard<std::mutex> lock(Database::dbMutex);
-		*sql << "SELECT * FROM assignments WHERE id=:id", soci::use(req.m_info.parameters["assignment_id"]), soci::into(assignment);
+		Database::Connection sql = Database::GetInstance()->Lease();
+		sql.Timed("select_assignment", { { "assignment_id", req.m_info.parameters["assignment_id"] } }, [&]() {
+			*sql << "SELECT " + ColumnList<Assignment>() + " FROM assignments WHERE id=:id", soci::use(req.m_info.parameters["assignment_id"]), soci::into(assignment);
+			return sql->got_data();
+		});
 
 		if (assignment.title.empty()) {
 			return { CppHttp::Net::ResponseType::NOT_FOUND, "Assignment not found", {} };
@@ -979,14 +901,20 @@ returnType GradeAssignment(CppHttp::Net::Request req) {
 
 	Grade assignmentGrade;
 	{
-		std::lock_guard<std::mutex> lock(Database::dbMutex);
-		*sql << "SELECT * FROM assignment_grades WHERE user_id=:user_id AND assignment_id=:assignment_id", soci::use(req.m_info.parameters["user_id"]), soci::use(req.m_info.parameters["assignment_id"]);
+		Database::Connection sql = Database::GetInstance()->Lease();
+		sql.Timed("select_grade_of_user", { { "user_id", req.m_info.parameters["user_id"] }, { "assignment_id", req.m_info.parameters["assignment_id"] } }, [&]() {
+			*sql << "SELECT " + ColumnList<Grade>() + " FROM assignment_grades WHERE user_id=:user_id AND assignment_id=:assignment_id", soci::use(req.m_info.parameters["user_id"]), soci::use(req.m_info.parameters["assignment_id"]);
+			return sql->got_data();
+		});
 
 		if (sql->got_data()) {
 			return { CppHttp::Net::ResponseType::BAD_REQUEST, "Assignment already graded", {} };
 		}
 
-		*sql << "INSERT INTO assignment_grades(user_id, assignment_id, grade, feedback) VALUES (:user_id, :assignment_id, :grade, :feedback) RETURNING *", soci::use(req.m_info.parameters["user_id"]), soci::use(req.m_info.parameters["assignment_id"]), soci::use(grade), soci::use(feedback), soci::into(assignmentGrade);
+		sql.Timed("insert_grade", { { "user_id", req.m_info.parameters["user_id"] }, { "assignment_id", req.m_info.parameters["assignment_id"] }, { "grade", grade }, { "feedback", feedback } }, [&]() {
+			*sql << "INSERT INTO assignment_grades(user_id, assignment_id, grade, feedback) VALUES (:user_id, :assignment_id, :grade, :feedback) RETURNING " + ColumnList<Grade>(), soci::use(req.m_info.parameters["user_id"]), soci::use(req.m_info.parameters["assignment_id"]), soci::use(grade), soci::use(feedback), soci::into(assignmentGrade);
+			return 1;
+		});
 	}
 
 	json response = {
@@ -997,99 +925,180 @@ returnType GradeAssignment(CppHttp::Net::Request req) {
 		{ "feedback", assignmentGrade.feedback }
 	};
 
-	return { CppHttp::Net::ResponseType::JSON, response.dump(4), {} };
+	return { CppHttp::Net::ResponseType::JSON, response.dump(4), ReadTokenHeader() };
 }
 
-returnType RemoveGrade(CppHttp::Net::Request req) {
-	if (req.m_info.parameters["grade_id"].empty()) {
-		return { CppHttp::Net::ResponseType::BAD_REQUEST, "Missing grade_id in path parameters", {} };
+returnType BulkGradeAssignment(CppHttp::Net::Request& req) {
+	if (req.m_info.parameters["assignment_id"].empty()) {
+		return { CppHttp::Net::ResponseType::BAD_REQUEST, "Missing assignment_id in path parameters", {} };
 	}
 
-	soci::session* sql = Database::GetInstance()->GetSession();
-	std::string token = req.m_info.headers["Authorization"];
-
-	auto tokenResult = ValidateToken(token);
+	const Principal& principal = GetPrincipal(req);
 
-	if (std::holds_alternative<TokenError>(tokenResult)) {
-		auto error = std::get<TokenError>(tokenResult);
-		return { error.type, error.message, {} };
+	if (!principal.IsTeacher()) {
+		return { CppHttp::Net::ResponseType::FORBIDDEN, "User is not a teacher", {} };
 	}
 
-	auto tokenJson = std::get<json>(tokenResult);
-	std::string id = tokenJson["id"];
+	std::optional<int> assignmentId = ParseId(req.m_info.parameters["assignment_id"]);
+	std::optional<int> classroomId = assignmentId.has_value() ? Membership::GetInstance()->ClassroomOfAssignment(*assignmentId) : std::nullopt;
 
-	User user;
-	{
-		std::lock_guard<std::mutex> lock(Database::dbMutex);
-		*sql << "SELECT * FROM users WHERE id=:user_id", soci::use(id), soci::into(user);
+	if (!classroomId.has_value()) {
+		return { CppHttp::Net::ResponseType::NOT_FOUND, "Assignment not found", {} };
 	}
 
-	if (user.email.empty()) {
+	if (!IsClassroomMember(principal, *classroomId)) {
 		return { CppHttp::Net::ResponseType::FORBIDDEN, "User is not a member of this classroom", {} };
 	}
 
-	std::transform(user.role.begin(), user.role.end(), user.role.begin(), ::toupper);
+	json body;
+	try {
+		body = json::parse(req.m_info.body);
+	}
+	catch (json::parse_error& e) {
+		return { CppHttp::Net::ResponseType::BAD_REQUEST, "Invalid JSON", {} };
+	}
+
+	static const size_t maxGrades = (size_t)std::max<long long>(1, GetEnvNumber("BULK_GRADE_MAX", 1000));
 
-	if (user.role != "TEACHER" && user.role != "ADMIN") {
-		return { CppHttp::Net::ResponseType::FORBIDDEN, "User is not a teacher", {} };
+	if (!body.is_array() || body.empty()) {
+		return { CppHttp::Net::ResponseType::BAD_REQUEST, "Body must be a non-empty array of grades", {} };
 	}
 
-	Grade grade;
-	{
-		std::lock_guard<std::mutex> lock(Database::dbMutex);
-		*sql << "SELECT * FROM assignment_grades WHERE id=:id", soci::use(req.m_info.parameters["grade_id"]), soci::into(grade);
+	if (body.size() > maxGrades) {
+		return { CppHttp::Net::ResponseType::BAD_REQUEST, "At most " + std::to_string(maxGrades) + " grades per request", {} };
+	}
 
-		if (grade.id == 0) {
-			return { CppHttp::Net::ResponseType::NOT_FOUND, "Grade not found", {} };
+	std::vector<int> userIds;
+	std::vector<double> grades;
+	std::vector<std::string> feedback;
+	userIds.reserve(body.size());
+	grades.reserve(body.size());
+	feedback.reserve(body.size());
+
+	for (auto& entry : body) {
+		if (!entry.is_object() || !entry.contains("user_id") || !entry["user_id"].is_number_integer()) {
+			return { CppHttp::Net::ResponseType::BAD_REQUEST, "Every grade needs an integer user_id", {} };
+		}
+
+		if (!entry.contains("grade") || !entry["grade"].is_number() || entry["grade"] < 0 || entry["grade"] > 100) {
+			return { CppHttp::Net::ResponseType::BAD_REQUEST, "Grade must be a percentage", {} };
 		}
+
+		if (entry.contains("feedback") && !entry["feedback"].is_string()) {
+			return { CppHttp::Net::ResponseType::BAD_REQUEST, "Feedback must be a string", {} };
+		}
+
+		userIds.push_back(entry["user_id"]);
+		grades.push_back(entry["grade"]);
+		feedback.push_back(entry.value("feedback", ""));
+	}
+
+	// one statement cannot update the same row twice
+	std::vector<int> sortedIds = userIds;
+	std::sort(sortedIds.begin(), sortedIds.end());
+	if (std::adjacent_find(sortedIds.begin(), sortedIds.end()) != sortedIds.end()) {
+		return { CppHttp::Net::ResponseType::BAD_REQUEST, "Each user can only be graded once per request", {} };
 	}
 
+	json response = json::array();
 	{
-		std::lock_guard<std::mutex> lock(Database::dbMutex);
-		*sql << "DELETE FROM assignment_grades WHERE id=:id", soci::use(req.m_info.parameters["grade_id"]);
+		// the lock taken before the upsert is held until the commit
+		UnitOfWork unit;
+		Database::Connection& sql = unit.Connection();
+
+		// membership of the whole set in one query, every grade is rejected if any user is not in the classroom
+		QueryResult members = sql.Execute(Statements::SelectMembers, *classroomId, sortedIds);
+
+		if (members.Rows() != (int)sortedIds.size()) {
+			std::vector<int> found;
+			for (int row = 0; row < members.Rows(); ++row) {
+				found.push_back(members.GetInt(row, 0));
+			}
+			std::sort(found.begin(), found.end());
+
+			std::vector<int> missing;
+			std::set_difference(sortedIds.begin(), sortedIds.end(), found.begin(), found.end(), std::back_inserter(missing));
+
+			std::string message = "Users are not members of this classroom: ";
+			for (size_t i = 0; i < missing.size(); ++i) {
+				message += (i > 0 ? ", " : "") + std::to_string(missing[i]);
+			}
+
+			return { CppHttp::Net::ResponseType::FORBIDDEN, message, {} };
+		}
+
+		sql.Execute(Statements::LockAssignmentGrades, *assignmentId);
+		QueryResult saved = sql.Execute(Statements::UpsertGrades, *assignmentId, userIds, grades, feedback);
+
+		for (int row = 0; row < saved.Rows(); ++row) {
+			response.push_back({
+				{ "id", saved.GetInt(row, 0) },
+				{ "userId", saved.GetInt(row, 1) },
+				{ "assignmentId", *assignmentId },
+				{ "grade", saved.GetDouble(row, 2) },
+				{ "feedback", saved.Get(row, 3) }
+			});
+		}
+
+		unit.Commit();
 	}
 
-	return { CppHttp::Net::ResponseType::OK, "Grade removed", {} };
+	return { CppHttp::Net::ResponseType::JSON, response.dump(4), ReadTokenHeader() };
 }
 
-returnType EditGrade(CppHttp::Net::Request req) {
+returnType RemoveGrade(CppHttp::Net::Request& req) {
 	if (req.m_info.parameters["grade_id"].empty()) {
 		return { CppHttp::Net::ResponseType::BAD_REQUEST, "Missing grade_id in path parameters", {} };
 	}
 
-	soci::session* sql = Database::GetInstance()->GetSession();
-	std::string token = req.m_info.headers["Authorization"];
-
-	auto tokenResult = ValidateToken(token);
+	const Principal& principal = GetPrincipal(req);
 
-	if (std::holds_alternative<TokenError>(tokenResult)) {
-		auto error = std::get<TokenError>(tokenResult);
-		return { error.type, error.message, {} };
+	if (!principal.IsTeacher()) {
+		return { CppHttp::Net::ResponseType::FORBIDDEN, "User is not a teacher", {} };
 	}
 
-	auto tokenJson = std::get<json>(tokenResult);
-	std::string id = tokenJson["id"];
+	Grade grade;
+	{
+		Database::Connection sql = Database::GetInstance()->Lease();
+		sql.Timed("select_grade", { { "grade_id", req.m_info.parameters["grade_id"] } }, [&]() {
+			*sql << "SELECT " + ColumnList<Grade>() + " FROM assignment_grades WHERE id=:id", soci::use(req.m_info.parameters["grade_id"]), soci::into(grade);
+			return sql->got_data();
+		});
+
+		if (grade.id == 0) {
+			return { CppHttp::Net::ResponseType::NOT_FOUND, "Grade not found", {} };
+		}
+	}
 
-	User user;
 	{
-		std::lock_guard<std::mutex> lock(Database::dbMutex);
-		*sql << "SELECT * FROM users WHERE id=:user_id", soci::use(id), soci::into(user);
+		Database::Connection sql = Database::GetInstance()->Lease();
+		sql.Timed("delete_grade", { { "grade_id", req.m_info.parameters["grade_id"] } }, [&]() {
+			*sql << "DELETE FROM assignment_grades WHERE id=:id", soci::use(req.m_info.parameters["grade_id"]);
+			return 0;
+		});
 	}
 
-	if (user.email.empty()) {
-		return { CppHttp::Net::ResponseType::FORBIDDEN, "User is not a member of this classroom", {} };
+	return { CppHttp::Net::ResponseType::OK, "Grade removed", ReadTokenHeader() };
+}
+
+returnType EditGrade(CppHttp::Net::Request& req) {
+	if (req.m_info.parameters["grade_id"].empty()) {
+		return { CppHttp::Net::ResponseType::BAD_REQUEST, "Missing grade_id in path parameters", {} };
 	}
 
-	std::transform(user.role.begin(), user.role.end(), user.role.begin(), ::toupper);
+	const Principal& principal = GetPrincipal(req);
 
-	if (user.role != "TEACHER" && user.role != "ADMIN") {
+	if (!principal.IsTeacher()) {
 		return { CppHttp::Net::ResponseType::FORBIDDEN, "User is not a teacher", {} };
 	}
 
 	Grade grade;
 	{
-		std::lock_guard<std::mutex> lock(Database::dbMutex);
-		*sql << "SELECT * FROM assignment_grades WHERE id=:id", soci::use(req.m_info.parameters["grade_id"]), soci::into(grade);
+		Database::Connection sql = Database::GetInstance()->Lease();
+		sql.Timed("select_grade", { { "grade_id", req.m_info.parameters["grade_id"] } }, [&]() {
+			*sql << "SELECT " + ColumnList<Grade>() + " FROM assignment_grades WHERE id=:id", soci::use(req.m_info.parameters["grade_id"]), soci::into(grade);
+			return sql->got_data();
+		});
 
 		if (grade.id == 0) {
 			return { CppHttp::Net::ResponseType::NOT_FOUND, "Grade not found", {} };
@@ -1116,8 +1125,11 @@ returnType EditGrade(CppHttp::Net::Request req) {
 	}
 
 	{
-		std::lock_guard<std::mutex> lock(Database::dbMutex);
-		*sql << "UPDATE assignment_grades SET grade=:grade, feedback=:feedback WHERE id=:id RETURNING *", soci::use(newGrade), soci::use(feedback), soci::use(req.m_info.parameters["grade_id"]), soci::into(grade);
+		Database::Connection sql = Database::GetInstance()->Lease();
+		sql.Timed("update_grade", { { "grade", newGrade }, { "feedback", feedback }, { "grade_id", req.m_info.parameters["grade_id"] } }, [&]() {
+			*sql << "UPDATE assignment_grades SET grade=:grade, feedback=:feedback WHERE id=:id RETURNING " + ColumnList<Grade>(), soci::use(newGrade), soci::use(feedback), soci::use(req.m_info.parameters["grade_id"]), soci::into(grade);
+			return sql->got_data();
+		});
 	}
 
 	json response = {
@@ -1128,7 +1140,7 @@ returnType EditGrade(CppHttp::Net::Request req) {
 		{ "feedback", grade.feedback }
 	};
 
-	return { CppHttp::Net::ResponseType::JSON, response.dump(4), {} };
+	return { CppHttp::Net::ResponseType::JSON, response.dump(4), ReadTokenHeader() };
 }
 
 #pragma endregion
\ No newline at end of file
@@ -1,6 +1,6 @@
 #include "../include/formParser.hpp"
 
-FormParser::FormParser(CppHttp::Net::Request req) {
+FormParser::FormParser(CppHttp::Net::Request& req) {
 	this->body = req.m_info.ubody;
 
 	if (req.m_info.headers["Content-Type"].find("boundary=") != std::string::npos) {
@@ -1,8 +1,12 @@
 #include "../include/endpoints.hpp"
+#include "../include/tokenVerifier.hpp"
+#include "../include/metrics.hpp"
+#include "../include/warmup.hpp"
 #include <thread>
 
 int main() {
-	Database::GetInstance();
+	TokenVerifier::ReloadOnHangup();
+	Warmup();
 	std::cout << "Starting server on port 8003\n";
 	CppHttp::Net::Router router;
 	CppHttp::Net::TcpListener server;
@@ -11,11 +15,17 @@ int main() {
 	int requestCount = 0;
 
 	auto onReceive = [&](CppHttp::Net::Request req) {
-		router.Handle(req);
+		return router.HandleAsync(std::move(req));
 	};
 
-	server.SetOnReceive(onReceive);
+	server.SetOnReceiveAsync(onReceive);
 
+	router.Use(Authenticate);
+	router.OnResponse(RecordAuthStatistics);
+	router.AllowRequestHeader("X-Read-Token");
+
+	// scraped by monitoring, which has no user token
+	router.AddRoute("GET", "/metrics", GetMetrics, CppHttp::Net::Router::Access::PUBLIC);
 	router.AddRoute("GET", "/assignment/classroom/{classroom_id}/get/all", GetAllAssignments);
 	router.AddRoute("GET", "/assignment/{assignment_id}/get", GetAssignment);
 	router.AddRoute("POST", "/assignment/classroom/{classroom_id}/create", CreateAssignment);
@@ -25,6 +35,7 @@ int main() {
 	router.AddRoute("DELETE", "/submission/{submission_id}/delete", DeleteSubmission);
 	router.AddRoute("GET", "/assignment/{assignment_id}/submission/get/all", GetAllSubmissions);
 	router.AddRoute("POST", "/assignment/{assignment_id}/user/{user_id}/grade", GradeAssignment);
+	router.AddRoute("POST", "/assignment/{assignment_id}/grade/bulk", BulkGradeAssignment);
 	router.AddRoute("DELETE", "/grade/{grade_id}/delete", RemoveGrade);
 	router.AddRoute("PUT", "/grade/{grade_id}/edit", EditGrade);
 
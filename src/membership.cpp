@@ -0,0 +1,156 @@
+#include "../include/membership.hpp"
+#include "../include/config.hpp"
+#include "../include/database.hpp"
+#include "../include/metrics.hpp"
+#include <algorithm>
+
+Membership::Membership() :
+	members(GetEnvNumber("MEMBERSHIP_CACHE_SIZE", 100000)),
+	assignmentClassrooms(GetEnvNumber("MEMBERSHIP_CACHE_SIZE", 100000)),
+	submissionAssignments(GetEnvNumber("MEMBERSHIP_CACHE_SIZE", 100000)),
+	memberTtl(GetEnvNumber("MEMBERSHIP_TTL", 60)),
+	nonMemberTtl(GetEnvNumber("MEMBERSHIP_NEGATIVE_TTL", 5)),
+	indexTtl(GetEnvNumber("MEMBERSHIP_INDEX_TTL", 3600))
+{
+	Metrics* metrics = Metrics::GetInstance();
+	metrics->Register("membership_cache_hits_total", Metrics::Type::COUNTER, "Classroom membership checks answered from memory", [this]() {
+		return (double)this->members.Hits();
+	});
+	metrics->Register("membership_cache_misses_total", Metrics::Type::COUNTER, "Classroom membership checks that queried the database", [this]() {
+		return (double)this->members.Misses();
+	});
+	metrics->Register("assignment_index_hits_total", Metrics::Type::COUNTER, "Assignment to classroom lookups answered from memory", [this]() {
+		return (double)this->assignmentClassrooms.Hits();
+	});
+	metrics->Register("assignment_index_misses_total", Metrics::Type::COUNTER, "Assignment to classroom lookups that queried the database", [this]() {
+		return (double)this->assignmentClassrooms.Misses();
+	});
+}
+
+bool Membership::IsMember(int classroomId, int userId, bool* queried) {
+	uint64_t key = Key(classroomId, userId);
+
+	std::optional<bool> cached = members.Get(key);
+	if (cached.has_value()) {
+		return *cached;
+	}
+
+	if (queried != nullptr) {
+		*queried = true;
+	}
+
+	bool member = false;
+	{
+		Database::Connection sql = Database::GetInstance()->Lease();
+		member = sql.Execute(Statements::SelectMembership, classroomId, userId).Rows() > 0;
+	}
+
+	members.Put(key, member, member ? memberTtl : nonMemberTtl);
+
+	return member;
+}
+
+std::optional<int> Membership::ClassroomOfAssignment(int assignmentId) {
+	std::optional<int> cached = assignmentClassrooms.Get(assignmentId);
+	if (cached.has_value()) {
+		return cached;
+	}
+
+	int classroomId = 0;
+	{
+		Database::Connection sql = Database::GetInstance()->Lease();
+		QueryResult result = sql.Execute(Statements::SelectAssignmentClassroom, assignmentId);
+
+		if (result.Rows() == 0) {
+			return std::nullopt;
+		}
+
+		classroomId = result.GetInt(0, 0);
+	}
+
+	assignmentClassrooms.Put(assignmentId, classroomId, indexTtl);
+
+	return classroomId;
+}
+
+std::optional<int> Membership::ClassroomOfSubmission(int submissionId) {
+	std::optional<int> assignmentId = submissionAssignments.Get(submissionId);
+
+	if (!assignmentId.has_value()) {
+		int loaded = 0;
+		{
+			Database::Connection sql = Database::GetInstance()->Lease();
+			QueryResult result = sql.Execute(Statements::SelectSubmissionAssignment, submissionId);
+
+			if (result.Rows() == 0) {
+				return std::nullopt;
+			}
+
+			loaded = result.GetInt(0, 0);
+		}
+
+		submissionAssignments.Put(submissionId, loaded, indexTtl);
+		assignmentId = loaded;
+	}
+
+	return ClassroomOfAssignment(*assignmentId);
+}
+
+void Membership::RememberAssignment(int assignmentId, int classroomId) {
+	assignmentClassrooms.Put(assignmentId, classroomId, indexTtl);
+}
+
+void Membership::RememberSubmission(int submissionId, int assignmentId) {
+	submissionAssignments.Put(submissionId, assignmentId, indexTtl);
+}
+
+size_t Membership::Preload(int assignments) {
+	std::vector<int> classroomIds;
+	size_t loaded = 0;
+
+	Database::Connection sql = Database::GetInstance()->Lease();
+
+	sql.Timed("preload_assignments", { { "fetch", assignments } }, [&]() {
+		soci::rowset<soci::row> rows = (sql->prepare << "SELECT id, classroom_id FROM assignments ORDER BY id DESC LIMIT :fetch", soci::use(assignments));
+
+		size_t count = 0;
+		for (const soci::row& row : rows) {
+			int classroomId = row.get<int>(1);
+			assignmentClassrooms.Put(row.get<int>(0), classroomId, indexTtl);
+			classroomIds.push_back(classroomId);
+			++count;
+		}
+		return count;
+	});
+
+	if (classroomIds.empty()) {
+		return 0;
+	}
+
+	std::sort(classroomIds.begin(), classroomIds.end());
+	classroomIds.erase(std::unique(classroomIds.begin(), classroomIds.end()), classroomIds.end());
+
+	// no more members than the cache holds, the rest would only evict each other
+	int fetch = (int)GetEnvNumber("MEMBERSHIP_CACHE_SIZE", 100000);
+	std::string ids = ToArrayLiteral(classroomIds);
+
+	sql.Timed("preload_members", { { "ids", ids }, { "fetch", fetch } }, [&]() {
+		soci::rowset<soci::row> rows = (sql->prepare << "SELECT classroom_id, user_id FROM classroom_users WHERE classroom_id = ANY(CAST(:ids AS int[])) LIMIT :fetch", soci::use(ids), soci::use(fetch));
+
+		for (const soci::row& row : rows) {
+			members.Put(Key(row.get<int>(0), row.get<int>(1)), true, memberTtl);
+			++loaded;
+		}
+		return loaded;
+	});
+
+	return loaded;
+}
+
+void Membership::ForgetAssignment(int assignmentId) {
+	assignmentClassrooms.Erase(assignmentId);
+}
+
+void Membership::ForgetSubmission(int submissionId) {
+	submissionAssignments.Erase(submissionId);
+}
@@ -0,0 +1,75 @@
+#include "../include/metrics.hpp"
+#include <sstream>
+#include <unordered_map>
+
+namespace {
+	const char* TypeName(Metrics::Type type) {
+		switch (type) {
+		case Metrics::Type::COUNTER:
+			return "counter";
+		case Metrics::Type::HISTOGRAM:
+			return "histogram";
+		default:
+			return "gauge";
+		}
+	}
+
+	// name without its labels, and for histograms without the _bucket, _sum or _count suffix
+	std::string Family(const std::string& name, Metrics::Type type) {
+		std::string family = name.substr(0, name.find('{'));
+
+		if (type == Metrics::Type::HISTOGRAM) {
+			for (const char* suffix : { "_bucket", "_sum", "_count" }) {
+				if (family.ends_with(suffix)) {
+					family.resize(family.size() - std::char_traits<char>::length(suffix));
+					break;
+				}
+			}
+		}
+
+		return family;
+	}
+}
+
+void Metrics::Register(std::string name, Type type, std::string help, std::function<double()> read) {
+	std::lock_guard<std::mutex> lock(this->mutex);
+	this->metrics.push_back(Metric{ std::move(name), type, std::move(help), std::move(read) });
+}
+
+std::string Metrics::Render() {
+	std::lock_guard<std::mutex> lock(this->mutex);
+
+	std::ostringstream out;
+	out.precision(12);
+
+	// metrics registered with labels, e.g. name{pool="primary"}, share one HELP and TYPE header per name
+	std::vector<std::string> families;
+	std::unordered_map<std::string, std::vector<const Metric*>> byFamily;
+
+	for (const Metric& metric : this->metrics) {
+		std::string family = Family(metric.name, metric.type);
+		auto& members = byFamily[family];
+
+		if (members.empty()) {
+			families.push_back(family);
+		}
+		members.push_back(&metric);
+	}
+
+	for (const std::string& family : families) {
+		const std::vector<const Metric*>& members = byFamily[family];
+
+		out << "# HELP " << family << " " << members.front()->help << "\n";
+		out << "# TYPE " << family << " " << TypeName(members.front()->type) << "\n";
+
+		for (const Metric* metric : members) {
+			out << metric->name << " " << metric->read() << "\n";
+		}
+	}
+
+	return out.str();
+}
+
+std::tuple<CppHttp::Net::ResponseType, std::string, std::optional<std::vector<std::string>>> GetMetrics([[maybe_unused]] CppHttp::Net::Request& req) {
+	return { CppHttp::Net::ResponseType::OK, Metrics::GetInstance()->Render(), {} };
+}
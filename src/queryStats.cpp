@@ -0,0 +1,155 @@
+#include "../include/queryStats.hpp"
+#include "../include/config.hpp"
+#include "../include/metrics.hpp"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <syncstream>
+
+namespace {
+	constexpr double secondBounds[] = { 0.0005, 0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1, 2.5, 5 };
+	constexpr double rowBounds[] = { 0, 1, 5, 10, 50, 100, 500, 1000, 5000 };
+
+	// parameters whose string values are safe to print; everything else (submission text, feedback, emails, links) is redacted
+	constexpr const char* shownParameters[] = { "id", "ids", "classroom_id", "assignment_id", "submission_id", "user_id", "grade_id", "after", "fetch", "grade", "due_date" };
+
+	bool IsShown(const char* name) {
+		return name != nullptr && std::any_of(std::begin(shownParameters), std::end(shownParameters), [name](const char* shown) { return std::strcmp(shown, name) == 0; });
+	}
+
+	void RegisterHistogram(const std::string& name, const std::string& label, const std::string& help, const Histogram& histogram) {
+		Metrics* metrics = Metrics::GetInstance();
+		std::span<const double> bounds = histogram.Bounds();
+
+		for (size_t i = 0; i <= bounds.size(); ++i) {
+			std::ostringstream le;
+			if (i == bounds.size()) {
+				le << "+Inf";
+			}
+			else {
+				le << bounds[i];
+			}
+
+			metrics->Register(name + "_bucket{statement=\"" + label + "\",le=\"" + le.str() + "\"}", Metrics::Type::HISTOGRAM, help, [&histogram, i]() {
+				return (double)histogram.Cumulative(i);
+			});
+		}
+
+		metrics->Register(name + "_sum{statement=\"" + label + "\"}", Metrics::Type::HISTOGRAM, help, [&histogram]() {
+			return histogram.Sum();
+		});
+		metrics->Register(name + "_count{statement=\"" + label + "\"}", Metrics::Type::HISTOGRAM, help, [&histogram]() {
+			return (double)histogram.Count();
+		});
+	}
+}
+
+void Histogram::Observe(double value) {
+	size_t bucket = std::lower_bound(bounds.begin(), bounds.end(), value) - bounds.begin();
+
+	buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+	sum.fetch_add(value, std::memory_order_relaxed);
+	count.fetch_add(1, std::memory_order_relaxed);
+}
+
+uint64_t Histogram::Cumulative(size_t bucket) const {
+	uint64_t total = 0;
+
+	for (size_t i = 0; i <= bucket; ++i) {
+		total += buckets[i].load(std::memory_order_relaxed);
+	}
+
+	return total;
+}
+
+StatementStats::StatementStats(std::string label) :
+	label(std::move(label)),
+	seconds(secondBounds),
+	rows(rowBounds),
+	waitSeconds(secondBounds)
+{}
+
+QueryStats::QueryStats() :
+	slowThreshold(std::chrono::milliseconds(GetEnvNumber("SLOW_QUERY_MS", 200))),
+	sampleEvery(std::max<long long>(1, GetEnvNumber("SLOW_QUERY_SAMPLE", 1)))
+{
+	overflow = new StatementStats("other");
+	Export(*overflow);
+}
+
+void QueryStats::Export(const StatementStats& stats) {
+	RegisterHistogram("db_query_duration_seconds", stats.label, "Time spent running statements", stats.seconds);
+	RegisterHistogram("db_query_rows", stats.label, "Rows returned by statements", stats.rows);
+	RegisterHistogram("db_query_pool_wait_seconds", stats.label, "Time spent waiting for a pooled connection before running statements", stats.waitSeconds);
+}
+
+StatementStats& QueryStats::For(std::string_view label) {
+	size_t start = std::hash<std::string_view>{}(label);
+
+	for (size_t i = 0; i < capacity; ++i) {
+		std::atomic<StatementStats*>& slot = table[(start + i) % capacity];
+		StatementStats* stats = slot.load(std::memory_order_acquire);
+
+		if (stats == nullptr) {
+			StatementStats* created = new StatementStats(std::string(label));
+
+			if (slot.compare_exchange_strong(stats, created, std::memory_order_acq_rel)) {
+				// only the thread that claimed the slot exports it
+				Export(*created);
+				return *created;
+			}
+
+			// another thread claimed the slot first, stats now points at its entry
+			delete created;
+		}
+
+		if (stats->label == label) {
+			return *stats;
+		}
+	}
+
+	return *overflow;
+}
+
+bool QueryStats::Observe(StatementStats& stats, std::chrono::nanoseconds elapsed, std::chrono::nanoseconds waited, uint64_t rows) {
+	stats.seconds.Observe(elapsed.count() / 1e9);
+	stats.rows.Observe((double)rows);
+	stats.waitSeconds.Observe(waited.count() / 1e9);
+
+	return elapsed >= slowThreshold && slowQueries.fetch_add(1, std::memory_order_relaxed) % sampleEvery == 0;
+}
+
+void QueryStats::LogSlow(const StatementStats& stats, std::chrono::nanoseconds elapsed, std::chrono::nanoseconds waited, uint64_t rows, const std::vector<QueryParameter>& parameters) {
+	std::osyncstream(std::cout) << "\033[33m[!] Slow query " << stats.label << ": " << elapsed.count() / 1e6 << " ms, " << rows << " rows, waited " << waited.count() / 1e6 << " ms for a connection" << DescribeParameters(parameters) << "\033[0m\n";
+}
+
+std::string QueryStats::DescribeParameters(const std::vector<QueryParameter>& parameters) {
+	std::ostringstream description;
+
+	for (size_t i = 0; i < parameters.size(); ++i) {
+		const QueryParameter& parameter = parameters[i];
+		description << (i == 0 ? "; " : ", ");
+
+		if (parameter.name != nullptr) {
+			description << parameter.name;
+		}
+		else {
+			description << "$" << i + 1;
+		}
+
+		description << "=";
+
+		if (parameter.text == nullptr) {
+			description << parameter.number;
+		}
+		else if (IsShown(parameter.name)) {
+			description << *parameter.text;
+		}
+		else {
+			description << "<redacted " << parameter.text->size() << " bytes>";
+		}
+	}
+
+	return description.str();
+}
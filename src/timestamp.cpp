@@ -0,0 +1,257 @@
+#include "../include/timestamp.hpp"
+#include <chrono>
+
+#ifdef __linux__
+#include <time.h>
+#endif
+
+namespace {
+	constexpr int64_t secondsPerDay = 86400;
+
+	// Days since 1970-01-01 of a proleptic Gregorian date, and back (Howard Hinnant's civil calendar algorithms)
+	constexpr int64_t DaysFromCivil(int64_t year, unsigned month, unsigned day) {
+		year -= month <= 2;
+		const int64_t era = (year >= 0 ? year : year - 399) / 400;
+		const unsigned yearOfEra = (unsigned)(year - era * 400);
+		const unsigned dayOfYear = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+		const unsigned dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+		return era * 146097 + (int64_t)dayOfEra - 719468;
+	}
+
+	struct CivilDate {
+		int64_t year;
+		unsigned month;
+		unsigned day;
+	};
+
+	constexpr CivilDate CivilFromDays(int64_t days) {
+		days += 719468;
+		const int64_t era = (days >= 0 ? days : days - 146096) / 146097;
+		const unsigned dayOfEra = (unsigned)(days - era * 146097);
+		const unsigned yearOfEra = (dayOfEra - dayOfEra / 1460 + dayOfEra / 36524 - dayOfEra / 146096) / 365;
+		const unsigned dayOfYear = dayOfEra - (365 * yearOfEra + yearOfEra / 4 - yearOfEra / 100);
+		const unsigned shiftedMonth = (5 * dayOfYear + 2) / 153;
+		const unsigned day = dayOfYear - (153 * shiftedMonth + 2) / 5 + 1;
+		const unsigned month = shiftedMonth < 10 ? shiftedMonth + 3 : shiftedMonth - 9;
+		return { (int64_t)yearOfEra + era * 400 + (month <= 2), month, day };
+	}
+
+	static_assert(DaysFromCivil(1970, 1, 1) == 0);
+	static_assert(DaysFromCivil(2000, 3, 1) == 11017);
+
+	constexpr bool IsLeapYear(int64_t year) {
+		return year % 4 == 0 && (year % 100 != 0 || year % 400 == 0);
+	}
+
+	constexpr unsigned DaysInMonth(int64_t year, unsigned month) {
+		constexpr unsigned days[] = { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+		return month == 2 && IsLeapYear(year) ? 29 : days[month - 1];
+	}
+
+	// Reads the text front to back, each read consuming what it matched
+	class Reader {
+	public:
+		explicit Reader(std::string_view text) : text(text) {}
+
+		// between minDigits and maxDigits decimal digits
+		bool Number(int& value, size_t minDigits, size_t maxDigits) {
+			size_t digits = 0;
+			value = 0;
+			while (digits < maxDigits && digits < text.size() && text[digits] >= '0' && text[digits] <= '9') {
+				value = value * 10 + (text[digits] - '0');
+				++digits;
+			}
+
+			text.remove_prefix(digits);
+			return digits >= minDigits;
+		}
+
+		bool Literal(char expected) {
+			if (text.empty() || text.front() != expected) {
+				return false;
+			}
+
+			text.remove_prefix(1);
+			return true;
+		}
+
+		std::optional<char> Peek() const {
+			return text.empty() ? std::nullopt : std::optional<char>(text.front());
+		}
+
+		bool Done() const {
+			return text.empty();
+		}
+
+	private:
+		std::string_view text;
+	};
+
+	std::optional<Timestamp> Make(int year, int month, int day, int hour, int minute, int second) {
+		if (month < 1 || month > 12 || day < 1 || (unsigned)day > DaysInMonth(year, month)) {
+			return std::nullopt;
+		}
+
+		if (hour > 23 || minute > 59 || second > 59) {
+			return std::nullopt;
+		}
+
+		return Timestamp(DaysFromCivil(year, month, day) * secondsPerDay + hour * 3600 + minute * 60 + second);
+	}
+
+	void WriteDigits(char* out, int64_t value, int digits) {
+		for (int i = digits - 1; i >= 0; --i) {
+			out[i] = (char)('0' + value % 10);
+			value /= 10;
+		}
+	}
+
+	struct Fields {
+		int64_t year;
+		unsigned month;
+		unsigned day;
+		int64_t secondOfDay;
+	};
+
+	Fields Split(int64_t seconds) {
+		int64_t days = seconds / secondsPerDay;
+		int64_t secondOfDay = seconds % secondsPerDay;
+		if (secondOfDay < 0) {
+			secondOfDay += secondsPerDay;
+			--days;
+		}
+
+		CivilDate date = CivilFromDays(days);
+		return { date.year, date.month, date.day, secondOfDay };
+	}
+}
+
+std::optional<Timestamp> Timestamp::Parse(std::string_view text) {
+	Reader reader(text);
+	int day = 0, month = 0, year = 0, hour = 0, minute = 0, second = 0;
+
+	bool matched =
+		reader.Number(day, 1, 2) && reader.Literal('-') &&
+		reader.Number(month, 1, 2) && reader.Literal('-') &&
+		reader.Number(year, 4, 4) && reader.Literal(' ') &&
+		reader.Number(hour, 1, 2) && reader.Literal(':') &&
+		reader.Number(minute, 1, 2) && reader.Literal(':') &&
+		reader.Number(second, 1, 2) && reader.Done();
+
+	if (!matched) {
+		return std::nullopt;
+	}
+
+	return Make(year, month, day, hour, minute, second);
+}
+
+std::optional<Timestamp> Timestamp::ParseIso(std::string_view text) {
+	Reader reader(text);
+	int year = 0, month = 0, day = 0, hour = 0, minute = 0, second = 0;
+
+	bool matched =
+		reader.Number(year, 4, 4) && reader.Literal('-') &&
+		reader.Number(month, 2, 2) && reader.Literal('-') &&
+		reader.Number(day, 2, 2) && (reader.Literal('T') || reader.Literal(' ')) &&
+		reader.Number(hour, 2, 2) && reader.Literal(':') &&
+		reader.Number(minute, 2, 2) && reader.Literal(':') &&
+		reader.Number(second, 2, 2);
+
+	if (!matched) {
+		return std::nullopt;
+	}
+
+	// fractions of a second are dropped
+	if (reader.Literal('.')) {
+		int fraction = 0;
+		if (!reader.Number(fraction, 1, 9)) {
+			return std::nullopt;
+		}
+	}
+
+	std::optional<Timestamp> timestamp = Make(year, month, day, hour, minute, second);
+	if (!timestamp.has_value()) {
+		return std::nullopt;
+	}
+
+	// no zone means UTC
+	int offset = 0;
+	std::optional<char> zone = reader.Peek();
+	if (zone == 'Z') {
+		reader.Literal('Z');
+	}
+	else if (zone == '+' || zone == '-') {
+		reader.Literal(*zone);
+
+		int offsetHours = 0, offsetMinutes = 0;
+		if (!reader.Number(offsetHours, 2, 2) || (reader.Literal(':'), !reader.Number(offsetMinutes, 2, 2)) || offsetHours > 23 || offsetMinutes > 59) {
+			return std::nullopt;
+		}
+
+		offset = (offsetHours * 3600 + offsetMinutes * 60) * (*zone == '-' ? -1 : 1);
+	}
+
+	if (!reader.Done()) {
+		return std::nullopt;
+	}
+
+	return Timestamp(timestamp->Seconds() - offset);
+}
+
+Timestamp Timestamp::Now() {
+#ifdef __linux__
+	timespec now{};
+	if (clock_gettime(CLOCK_REALTIME_COARSE, &now) == 0) {
+		return Timestamp(now.tv_sec);
+	}
+#endif
+
+	return Timestamp(std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count());
+}
+
+Timestamp Timestamp::FromTm(const std::tm& tm) {
+	// normalise out-of-range fields the way timegm would
+	int64_t year = (int64_t)tm.tm_year + 1900 + tm.tm_mon / 12;
+	int month = tm.tm_mon % 12;
+	if (month < 0) {
+		month += 12;
+		--year;
+	}
+
+	int64_t days = DaysFromCivil(year, (unsigned)month + 1, 1) + tm.tm_mday - 1;
+	return Timestamp(days * secondsPerDay + (int64_t)tm.tm_hour * 3600 + (int64_t)tm.tm_min * 60 + tm.tm_sec);
+}
+
+std::tm Timestamp::ToTm() const {
+	Fields fields = Split(seconds);
+
+	std::tm tm = {};
+	tm.tm_year = (int)(fields.year - 1900);
+	tm.tm_mon = (int)fields.month - 1;
+	tm.tm_mday = (int)fields.day;
+	tm.tm_hour = (int)(fields.secondOfDay / 3600);
+	tm.tm_min = (int)(fields.secondOfDay / 60 % 60);
+	tm.tm_sec = (int)(fields.secondOfDay % 60);
+	tm.tm_wday = (int)((DaysFromCivil(fields.year, fields.month, fields.day) % 7 + 11) % 7);
+	tm.tm_yday = (int)(DaysFromCivil(fields.year, fields.month, fields.day) - DaysFromCivil(fields.year, 1, 1));
+	return tm;
+}
+
+std::string Timestamp::Format() const {
+	Fields fields = Split(seconds);
+
+	// DD-MM-YYYY HH:MM:SS
+	std::string text(19, '\0');
+	WriteDigits(&text[0], fields.day, 2);
+	text[2] = '-';
+	WriteDigits(&text[3], fields.month, 2);
+	text[5] = '-';
+	WriteDigits(&text[6], fields.year, 4);
+	text[10] = ' ';
+	WriteDigits(&text[11], fields.secondOfDay / 3600, 2);
+	text[13] = ':';
+	WriteDigits(&text[14], fields.secondOfDay / 60 % 60, 2);
+	text[16] = ':';
+	WriteDigits(&text[17], fields.secondOfDay % 60, 2);
+	return text;
+}
@@ -0,0 +1,212 @@
+#include "../include/tokenVerifier.hpp"
+#include "../include/config.hpp"
+#include "../include/metrics.hpp"
+#include <openssl/sha.h>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <syncstream>
+#include <thread>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <signal.h>
+#endif
+
+TokenVerifier::TokenVerifier() :
+	claimsCache(GetEnvNumber("TOKEN_CACHE_SIZE", 10000)),
+	maxCacheAge(GetEnvNumber("TOKEN_CACHE_MAX_AGE", 300))
+{
+	ReloadFromEnvironment();
+
+	Metrics* metrics = Metrics::GetInstance();
+	metrics->Register("token_cache_hits_total", Metrics::Type::COUNTER, "Requests whose token was found in the verified token cache", [this]() {
+		return (double)this->hits.load(std::memory_order_relaxed);
+	});
+	metrics->Register("token_cache_misses_total", Metrics::Type::COUNTER, "Requests whose token had to be verified", [this]() {
+		return (double)this->misses.load(std::memory_order_relaxed);
+	});
+	metrics->Register("token_cache_entries", Metrics::Type::GAUGE, "Verified tokens currently cached", [this]() {
+		return (double)this->claimsCache.Size();
+	});
+	metrics->Register("token_cache_cpu_seconds_saved_total", Metrics::Type::COUNTER, "Estimated verification time saved by cache hits", [this]() {
+		uint64_t count = this->verifyCount.load(std::memory_order_relaxed);
+		if (count == 0) {
+			return 0.0;
+		}
+
+		double averageSeconds = this->verifyNanos.load(std::memory_order_relaxed) / (double)count / 1e9;
+		return averageSeconds * this->hits.load(std::memory_order_relaxed);
+	});
+}
+
+namespace {
+	// keys are stored in the environment with escaped newlines
+	std::string UnescapePem(std::string pem) {
+		size_t pos = 0;
+
+		while ((pos = pem.find("\\n", pos)) != std::string::npos) {
+			pem.replace(pos, 2, "\n");
+		}
+
+		return pem;
+	}
+
+	std::string ReadFile(const char* path) {
+		std::ifstream file(path);
+		if (!file) {
+			throw std::runtime_error(std::string("Failed to read ") + path);
+		}
+
+		std::stringstream contents;
+		contents << file.rdbuf();
+		return contents.str();
+	}
+
+	template <typename Algorithm>
+	std::shared_ptr<const TokenVerifier::Verifier> MakeVerifier(Algorithm algorithm) {
+		return std::make_shared<const TokenVerifier::Verifier>(jwt::verify<jwt::traits::nlohmann_json>().allow_algorithm(algorithm).with_issuer("auth0"));
+	}
+}
+
+std::shared_ptr<const TokenVerifier::Verifier> TokenVerifier::VerifierFor(const DecodedToken& token) const {
+	std::shared_ptr<const KeyRing> keys = keyRing.load(std::memory_order_acquire);
+
+	// a kid that is not in the ring is rejected rather than tried against the RSASECRET key
+	if (token.has_key_id()) {
+		auto found = keys->byKeyId.find(token.get_key_id());
+		return found != keys->byKeyId.end() ? found->second : nullptr;
+	}
+
+	return keys->fallback;
+}
+
+void TokenVerifier::Reload(std::string defaultPem, const std::string& keyRingJson) {
+	auto keys = std::make_shared<KeyRing>();
+
+	if (!defaultPem.empty()) {
+		// RSASECRET holds the private key, the public half is derived from it
+		keys->fallback = MakeVerifier(jwt::algorithm::rs512{ "", UnescapePem(std::move(defaultPem)), "", "" });
+	}
+
+	for (auto& entry : nlohmann::json::parse(keyRingJson)) {
+		std::string keyId = entry.at("kid");
+		std::string algorithm = entry.at("alg");
+		std::string pem = UnescapePem(entry.at("key"));
+
+		std::shared_ptr<const Verifier> verifier;
+
+		if (algorithm == "RS512") {
+			verifier = MakeVerifier(jwt::algorithm::rs512{ pem });
+		}
+		else if (algorithm == "ES256") {
+			verifier = MakeVerifier(jwt::algorithm::es256{ pem });
+		}
+		else if (algorithm == "EdDSA") {
+			verifier = MakeVerifier(jwt::algorithm::ed25519{ pem });
+		}
+		else {
+			throw std::runtime_error("Unsupported algorithm " + algorithm + " for key " + keyId);
+		}
+
+		keys->byKeyId[keyId] = std::move(verifier);
+	}
+
+	if (keys->fallback == nullptr && keys->byKeyId.empty()) {
+		throw std::runtime_error("No token verification keys configured");
+	}
+
+	keyRing.store(std::move(keys), std::memory_order_release);
+	generation.fetch_add(1, std::memory_order_acq_rel);
+
+	// only frees memory: entries of the old generation are already ignored, including any remembered after this
+	claimsCache.Clear();
+}
+
+void TokenVerifier::ReloadFromEnvironment() {
+	const char* rsaSecret = std::getenv("RSASECRET");
+	const char* keysFile = std::getenv("JWT_KEYS_FILE");
+	const char* keys = std::getenv("JWT_KEYS");
+
+	std::string keyRingJson = "[]";
+	if (keysFile != nullptr && *keysFile != '\0') {
+		keyRingJson = ReadFile(keysFile);
+	}
+	else if (keys != nullptr && *keys != '\0') {
+		keyRingJson = keys;
+	}
+
+	Reload(rsaSecret == nullptr ? "" : rsaSecret, keyRingJson);
+}
+
+void TokenVerifier::ReloadOnHangup() {
+#ifdef __linux__
+	sigset_t hangup;
+	sigemptyset(&hangup);
+	sigaddset(&hangup, SIGHUP);
+
+	// threads started after this inherit the mask, so SIGHUP only ever reaches the watcher below
+	pthread_sigmask(SIG_BLOCK, &hangup, nullptr);
+
+	std::thread([hangup]() {
+		while (true) {
+			int signal = 0;
+			if (sigwait(&hangup, &signal) != 0) {
+				continue;
+			}
+
+			try {
+				TokenVerifier::GetInstance()->ReloadFromEnvironment();
+				std::osyncstream(std::cout) << "Reloaded token verification keys\n";
+			}
+			catch (std::exception& e) {
+				std::osyncstream(std::cout) << "\033[31m[-] Failed to reload token verification keys, keeping the current ones: " << e.what() << "\033[0m\n";
+			}
+		}
+	}).detach();
+#endif
+}
+
+TokenDigest TokenVerifier::Digest(const std::string& token) {
+	TokenDigest digest;
+	SHA256((const unsigned char*)token.data(), token.size(), digest.data());
+	return digest;
+}
+
+std::optional<TokenClaims> TokenVerifier::Lookup(const TokenDigest& digest) {
+	std::optional<CachedClaims> cached = claimsCache.Get(digest);
+
+	if (!cached.has_value()) {
+		misses.fetch_add(1, std::memory_order_relaxed);
+		return std::nullopt;
+	}
+
+	if (cached->generation != Generation() || !cached->claims.IsCurrent(std::chrono::system_clock::now())) {
+		claimsCache.Erase(digest);
+		misses.fetch_add(1, std::memory_order_relaxed);
+		return std::nullopt;
+	}
+
+	hits.fetch_add(1, std::memory_order_relaxed);
+	return std::move(cached->claims);
+}
+
+void TokenVerifier::Remember(const TokenDigest& digest, const TokenClaims& claims, uint64_t verifiedGeneration, std::chrono::nanoseconds verifyCost) {
+	verifyNanos.fetch_add(verifyCost.count(), std::memory_order_relaxed);
+	verifyCount.fetch_add(1, std::memory_order_relaxed);
+
+	auto now = std::chrono::system_clock::now();
+	if (!claims.IsCurrent(now)) {
+		return;
+	}
+
+	// keep the entry no longer than the token is valid for
+	std::chrono::steady_clock::duration ttl = maxCacheAge;
+	if (claims.expiresAt.has_value()) {
+		ttl = std::min(ttl, std::chrono::duration_cast<std::chrono::steady_clock::duration>(*claims.expiresAt - now));
+	}
+
+	claimsCache.Put(digest, CachedClaims{ claims, verifiedGeneration }, ttl);
+}
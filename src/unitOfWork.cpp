@@ -0,0 +1,248 @@
+#include "../include/unitOfWork.hpp"
+#include "../include/config.hpp"
+#include "../include/metrics.hpp"
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <mutex>
+#include <syncstream>
+#include <thread>
+#include <vector>
+
+UnitOfWork::UnitOfWork() : connection(Database::GetInstance()->Lease()) {
+	connection->begin();
+}
+
+UnitOfWork::~UnitOfWork() {
+	if (!active) {
+		return;
+	}
+
+	try {
+		connection->rollback();
+	}
+	catch (std::exception& e) {
+		std::osyncstream(std::cout) << "\033[31m[-] Rollback failed: " << e.what() << "\033[0m\n";
+	}
+}
+
+void UnitOfWork::Commit() {
+	connection->commit();
+	active = false;
+}
+
+namespace {
+	// Collects units of work from concurrent callers and commits them together, so a burst of
+	// writes pays for one WAL flush instead of one per request
+	// GROUP_COMMIT_CONNECTIONS committers each commit on their own session; one collects a batch at a time,
+	// so batches fill up instead of being split between them, while the others are still committing theirs
+	class GroupCommitter {
+	public:
+		static GroupCommitter* GetInstance() {
+			static GroupCommitter* instance = new GroupCommitter();
+			return instance;
+		}
+
+		bool Enabled() const {
+			return window.count() > 0;
+		}
+
+		void Run(UnitOfWork::Work work) {
+			std::promise<void> committed;
+			std::future<void> done = committed.get_future();
+
+			Enqueue(std::move(work), [&committed](std::exception_ptr failure) {
+				if (failure) {
+					committed.set_exception(failure);
+				}
+				else {
+					committed.set_value();
+				}
+			});
+
+			done.get();
+		}
+
+		// Resumes the awaiting coroutine once its work is committed, on the pool it was running on
+		class Committed {
+		public:
+			Committed(GroupCommitter& committer, UnitOfWork::Work work) : committer(committer), work(std::move(work)) {}
+
+			bool await_ready() const noexcept {
+				return false;
+			}
+
+			void await_suspend(std::coroutine_handle<> awaiting) {
+				CppHttp::Net::ThreadPool* resumeOn = CppHttp::Net::ThreadPool::Current() != nullptr ? CppHttp::Net::ThreadPool::Current() : &CppHttp::Net::ThreadPool::Blocking();
+
+				// nothing may touch this awaiter's members after Enqueue but the callback: the coroutine can resume before it returns
+				committer.Enqueue(std::move(work), [this, awaiting, resumeOn](std::exception_ptr failure) {
+					this->failure = failure;
+					resumeOn->Post([awaiting]() { awaiting.resume(); });
+				});
+			}
+
+			void await_resume() {
+				if (failure) {
+					std::rethrow_exception(failure);
+				}
+			}
+
+		private:
+			GroupCommitter& committer;
+			UnitOfWork::Work work;
+			std::exception_ptr failure;
+		};
+
+	private:
+		struct Pending {
+			UnitOfWork::Work work;
+			std::function<void(std::exception_ptr)> done;
+		};
+
+		GroupCommitter() :
+			window(GetEnvNumber("GROUP_COMMIT_WINDOW_MS", 0)),
+			maxBatch(std::max<long long>(1, GetEnvNumber("GROUP_COMMIT_MAX_BATCH", 64)))
+		{
+			Metrics* metrics = Metrics::GetInstance();
+			metrics->Register("group_commit_batches_total", Metrics::Type::COUNTER, "Transactions committed by the group committer", [this]() {
+				return (double)this->batches.load(std::memory_order_relaxed);
+			});
+			metrics->Register("group_commit_units_total", Metrics::Type::COUNTER, "Units of work committed by the group committer", [this]() {
+				return (double)this->units.load(std::memory_order_relaxed);
+			});
+
+			if (Enabled()) {
+				long long committers = std::max<long long>(1, GetEnvNumber("GROUP_COMMIT_CONNECTIONS", 2));
+				for (long long i = 0; i < committers; ++i) {
+					std::thread(&GroupCommitter::Loop, this).detach();
+				}
+			}
+		}
+
+		void Enqueue(UnitOfWork::Work work, std::function<void(std::exception_ptr)> done) {
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				queue.push_back(Pending{ std::move(work), std::move(done) });
+			}
+			// the collecting committer may be waiting for a full batch, and notify_one could wake an idle one instead
+			ready.notify_all();
+		}
+
+		void Loop() {
+			while (true) {
+				std::vector<Pending> batch;
+				{
+					std::unique_lock<std::mutex> lock(mutex);
+					ready.wait(lock, [this]() { return !collecting && !queue.empty(); });
+					collecting = true;
+
+					// give concurrent requests the window to join the first one
+					ready.wait_for(lock, window, [this]() { return queue.size() >= maxBatch; });
+
+					while (!queue.empty() && batch.size() < maxBatch) {
+						batch.push_back(std::move(queue.front()));
+						queue.pop_front();
+					}
+
+					collecting = false;
+				}
+				ready.notify_all();
+
+				Commit(batch);
+			}
+		}
+
+		void Commit(std::vector<Pending>& batch) {
+			std::vector<std::exception_ptr> failures(batch.size());
+
+			try {
+				UnitOfWork unit;
+				Database::Connection& sql = unit.Connection();
+
+				for (size_t i = 0; i < batch.size(); ++i) {
+					*sql << "SAVEPOINT unit_of_work";
+
+					try {
+						batch[i].work(sql);
+						*sql << "RELEASE SAVEPOINT unit_of_work";
+					}
+					catch (...) {
+						failures[i] = std::current_exception();
+						*sql << "ROLLBACK TO SAVEPOINT unit_of_work";
+					}
+				}
+
+				unit.Commit();
+			}
+			catch (...) {
+				// the shared transaction failed, so nothing in the batch was written
+				std::exception_ptr failure = std::current_exception();
+				for (auto& pending : batch) {
+					pending.done(failure);
+				}
+				return;
+			}
+
+			batches.fetch_add(1, std::memory_order_relaxed);
+			units.fetch_add(batch.size(), std::memory_order_relaxed);
+
+			for (size_t i = 0; i < batch.size(); ++i) {
+				batch[i].done(failures[i]);
+			}
+		}
+
+		std::chrono::milliseconds window;
+		size_t maxBatch;
+
+		std::mutex mutex;
+		std::condition_variable ready;
+		std::deque<Pending> queue;
+		bool collecting = false;
+
+		std::atomic<uint64_t> batches{ 0 };
+		std::atomic<uint64_t> units{ 0 };
+	};
+}
+
+void UnitOfWork::Run(Work work) {
+	GroupCommitter* committer = GroupCommitter::GetInstance();
+
+	if (committer->Enabled()) {
+		committer->Run(std::move(work));
+		return;
+	}
+
+	UnitOfWork unit;
+	work(unit.Connection());
+	unit.Commit();
+}
+
+CppHttp::Net::Task<void> UnitOfWork::RunAsync(Work work) {
+	GroupCommitter* committer = GroupCommitter::GetInstance();
+
+	if (committer->Enabled()) {
+		co_await GroupCommitter::Committed(*committer, std::move(work));
+		co_return;
+	}
+
+	co_await CppHttp::Net::Offload([&work]() {
+		UnitOfWork unit;
+		work(unit.Connection());
+		unit.Commit();
+	});
+}
+
+ReadSnapshot::ReadSnapshot(const std::string& readToken) : connection(Database::GetInstance()->LeaseForRead(readToken)) {
+	*connection << "BEGIN ISOLATION LEVEL REPEATABLE READ READ ONLY";
+}
+
+ReadSnapshot::~ReadSnapshot() {
+	// nothing was written, ending the transaction either way only releases the snapshot
+	try {
+		*connection << "ROLLBACK";
+	}
+	catch (std::exception& e) {
+		std::osyncstream(std::cout) << "\033[31m[-] Ending read snapshot failed: " << e.what() << "\033[0m\n";
+	}
+}
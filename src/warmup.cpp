@@ -0,0 +1,48 @@
+#include "../include/warmup.hpp"
+#include "../include/asyncDatabase.hpp"
+#include "../include/azure.hpp"
+#include "../include/config.hpp"
+#include "../include/database.hpp"
+#include "../include/membership.hpp"
+#include "../include/tokenVerifier.hpp"
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <syncstream>
+#include <utility>
+
+namespace {
+	long long MillisecondsSince(std::chrono::steady_clock::time_point start) {
+		return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+	}
+}
+
+void Warmup() {
+	auto start = std::chrono::steady_clock::now();
+
+	// each step builds a different singleton; a step that needs another's waits for it inside that GetInstance
+	std::vector<std::pair<const char*, std::function<void()>>> steps = {
+		{ "database pools", []() { Database::GetInstance(); } },
+		{ "nonblocking database connections", []() { AsyncDatabase::GetInstance(); } },
+		{ "token verifier", []() { TokenVerifier::GetInstance(); } },
+		// a HEAD on the container opens the pooled TLS connection the first upload would otherwise wait for, and checks the credentials
+		{ "blob storage client", []() { Blobs::GetInstance()->GetClient()->GetBlobContainerClient("assignments").GetProperties(); } },
+		{ "membership cache", []() { Membership::GetInstance(); } },
+		{ "socket reactor", []() { CppHttp::Net::Reactor::Instance(); } }
+	};
+
+	RunInParallel(steps.size(), [&steps](size_t i) {
+		auto stepStart = std::chrono::steady_clock::now();
+		steps[i].second();
+		std::osyncstream(std::cout) << "Warmed up " << steps[i].first << " in " << MillisecondsSince(stepStart) << " ms\n";
+	});
+
+	long long preload = GetEnvNumber("WARMUP_PRELOAD_ASSIGNMENTS", 0);
+	if (preload > 0) {
+		auto preloadStart = std::chrono::steady_clock::now();
+		size_t loaded = Membership::GetInstance()->Preload((int)preload);
+		std::osyncstream(std::cout) << "Preloaded " << loaded << " memberships in " << MillisecondsSince(preloadStart) << " ms\n";
+	}
+
+	std::osyncstream(std::cout) << "Ready after " << MillisecondsSince(start) << " ms\n";
+}
@@ -0,0 +1,44 @@
+#include "../include/queryStats.hpp"
+#include <iostream>
+#include <string>
+
+// The slow-query log must only print string values of parameters on the allow list in queryStats.cpp
+
+namespace {
+	int failures = 0;
+
+	void Expect(const std::string& name, const std::string& actual, const std::string& expected) {
+		if (actual != expected) {
+			std::cerr << name << ": expected \"" << expected << "\", got \"" << actual << "\"\n";
+			++failures;
+		}
+	}
+}
+
+int main() {
+	std::string ids = "{1,2,3}";
+	std::string text = "my essay";
+	std::string feedback = "well done";
+	std::string email = "student@example.com";
+	std::string link = "https://example.blob.core.windows.net/a";
+	std::string unnamed = "secret";
+
+	Expect("no parameters", QueryStats::DescribeParameters({}), "");
+
+	Expect("numbers are shown", QueryStats::DescribeParameters({ QueryParameter("grade", 9.5), QueryParameter("title", 3) }), "; grade=9.5, title=3");
+
+	Expect("allowed strings are shown", QueryStats::DescribeParameters({ QueryParameter("ids", ids), QueryParameter("user_id", ids) }), "; ids={1,2,3}, user_id={1,2,3}");
+
+	Expect("other strings are redacted", QueryStats::DescribeParameters({ QueryParameter("text", text), QueryParameter("feedback", feedback), QueryParameter("email", email), QueryParameter("link", link) }),
+		"; text=<redacted 8 bytes>, feedback=<redacted 9 bytes>, email=<redacted 19 bytes>, link=<redacted 39 bytes>");
+
+	Expect("allow list matches whole names", QueryStats::DescribeParameters({ QueryParameter("idx", unnamed), QueryParameter("user", unnamed) }), "; idx=<redacted 6 bytes>, user=<redacted 6 bytes>");
+
+	Expect("positional strings are redacted, ids shown", QueryStats::DescribeParameters({ QueryParameter::Positional(42, "42"), QueryParameter::Positional(unnamed, unnamed) }), "; $1=42, $2=<redacted 6 bytes>");
+
+	if (failures == 0) {
+		std::cout << "All query stats checks passed\n";
+	}
+
+	return failures == 0 ? 0 : 1;
+}
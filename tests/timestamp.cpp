@@ -0,0 +1,99 @@
+#include "../include/timestamp.hpp"
+#include <iostream>
+#include <string>
+
+// Timestamp parses and formats dates by hand, so the calendar rules are checked here against known values
+
+namespace {
+	int failures = 0;
+
+	void Expect(const std::string& name, const std::string& actual, const std::string& expected) {
+		if (actual != expected) {
+			std::cerr << name << ": expected \"" << expected << "\", got \"" << actual << "\"\n";
+			++failures;
+		}
+	}
+
+	// seconds since the epoch, or "invalid" when the text was rejected
+	std::string Seconds(const std::optional<Timestamp>& timestamp) {
+		return timestamp.has_value() ? std::to_string(timestamp->Seconds()) : "invalid";
+	}
+
+	std::string Formatted(const std::optional<Timestamp>& timestamp) {
+		return timestamp.has_value() ? timestamp->Format() : "invalid";
+	}
+}
+
+int main() {
+	Expect("epoch", Seconds(Timestamp::Parse("01-01-1970 00:00:00")), "0");
+	Expect("single digit fields", Seconds(Timestamp::Parse("2-1-1970 0:0:1")), "86401");
+
+	Expect("leap day", Formatted(Timestamp::Parse("29-02-2024 12:00:00")), "29-02-2024 12:00:00");
+	Expect("leap day of a 400th year", Formatted(Timestamp::Parse("29-02-2000 00:00:00")), "29-02-2000 00:00:00");
+	Expect("29-02 in a non-leap year", Seconds(Timestamp::Parse("29-02-2023 00:00:00")), "invalid");
+	Expect("29-02 in a century year", Seconds(Timestamp::Parse("29-02-1900 00:00:00")), "invalid");
+	Expect("31-04", Seconds(Timestamp::Parse("31-04-2026 00:00:00")), "invalid");
+	Expect("day after a leap day", Seconds(Timestamp::Parse("01-03-2024 00:00:00")), std::to_string(Timestamp::Parse("29-02-2024 00:00:00")->Seconds() + 86400));
+
+	Expect("second before the epoch", Seconds(Timestamp::Parse("31-12-1969 23:59:59")), "-1");
+	Expect("1900", Seconds(Timestamp::Parse("01-01-1900 00:00:00")), "-2208988800");
+	Expect("pre-1970 formats", Timestamp(-2208988800).Format(), "01-01-1900 00:00:00");
+	Expect("pre-1970 leap day", Formatted(Timestamp::Parse("29-02-1968 23:59:59")), "29-02-1968 23:59:59");
+
+	Expect("day 0", Seconds(Timestamp::Parse("00-01-2026 00:00:00")), "invalid");
+	Expect("day 32", Seconds(Timestamp::Parse("32-01-2026 00:00:00")), "invalid");
+	Expect("month 0", Seconds(Timestamp::Parse("01-00-2026 00:00:00")), "invalid");
+	Expect("month 13", Seconds(Timestamp::Parse("01-13-2026 00:00:00")), "invalid");
+	Expect("hour 24", Seconds(Timestamp::Parse("01-01-2026 24:00:00")), "invalid");
+	Expect("minute 60", Seconds(Timestamp::Parse("01-01-2026 12:60:00")), "invalid");
+	Expect("second 60", Seconds(Timestamp::Parse("01-01-2026 12:00:60")), "invalid");
+	Expect("two digit year", Seconds(Timestamp::Parse("01-01-26 12:00:00")), "invalid");
+	Expect("trailing text", Seconds(Timestamp::Parse("01-01-2026 12:00:00Z")), "invalid");
+	Expect("empty", Seconds(Timestamp::Parse("")), "invalid");
+
+	for (const char* text : { "19-10-2026 08:00:00", "01-01-1970 00:00:00", "31-12-1969 23:59:59", "29-02-2000 23:59:59", "31-12-9999 23:59:59", "01-01-0001 00:00:00" }) {
+		Expect(std::string("round trip of ") + text, Formatted(Timestamp::Parse(text)), text);
+	}
+
+	std::string utc = Seconds(Timestamp::Parse("19-10-2026 08:00:00"));
+	Expect("iso without zone is UTC", Seconds(Timestamp::ParseIso("2026-10-19T08:00:00")), utc);
+	Expect("iso with a space", Seconds(Timestamp::ParseIso("2026-10-19 08:00:00")), utc);
+	Expect("iso Z", Seconds(Timestamp::ParseIso("2026-10-19T08:00:00Z")), utc);
+	Expect("iso +HH:MM", Seconds(Timestamp::ParseIso("2026-10-19T10:00:00+02:00")), utc);
+	Expect("iso +HHMM", Seconds(Timestamp::ParseIso("2026-10-19T10:00:00+0200")), utc);
+	Expect("iso -HH:MM", Seconds(Timestamp::ParseIso("2026-10-19T02:30:00-05:30")), utc);
+	Expect("iso offset across midnight", Formatted(Timestamp::ParseIso("2026-10-20T01:00:00+09:00")), "19-10-2026 16:00:00");
+	Expect("iso fraction is dropped", Seconds(Timestamp::ParseIso("2026-10-19T08:00:00.999Z")), utc);
+	Expect("iso nanoseconds", Seconds(Timestamp::ParseIso("2026-10-19T10:00:00.123456789+02:00")), utc);
+	Expect("iso empty fraction", Seconds(Timestamp::ParseIso("2026-10-19T08:00:00.Z")), "invalid");
+	Expect("iso offset hour 24", Seconds(Timestamp::ParseIso("2026-10-19T08:00:00+24:00")), "invalid");
+	Expect("iso offset minute 60", Seconds(Timestamp::ParseIso("2026-10-19T08:00:00+01:60")), "invalid");
+	Expect("iso offset without minutes", Seconds(Timestamp::ParseIso("2026-10-19T08:00:00+02")), "invalid");
+	Expect("iso 31-04", Seconds(Timestamp::ParseIso("2026-04-31T00:00:00Z")), "invalid");
+	Expect("iso leap day", Formatted(Timestamp::ParseIso("2024-02-29T00:00:00Z")), "29-02-2024 00:00:00");
+	Expect("iso 29-02 in a non-leap year", Seconds(Timestamp::ParseIso("2023-02-29T00:00:00Z")), "invalid");
+	Expect("iso pre-1970", Seconds(Timestamp::ParseIso("1969-12-31T23:59:59Z")), "-1");
+	Expect("iso single digit month", Seconds(Timestamp::ParseIso("2026-1-19T08:00:00Z")), "invalid");
+	Expect("iso date only", Seconds(Timestamp::ParseIso("2026-10-19")), "invalid");
+
+	std::tm tm = Timestamp(-1).ToTm();
+	Expect("ToTm before the epoch", std::to_string(tm.tm_year) + " " + std::to_string(tm.tm_mon) + " " + std::to_string(tm.tm_mday) + " " + std::to_string(tm.tm_hour) + ":" + std::to_string(tm.tm_min) + ":" + std::to_string(tm.tm_sec), "69 11 31 23:59:59");
+	Expect("ToTm weekday", std::to_string(Timestamp(0).ToTm().tm_wday), "4");
+	Expect("ToTm day of year", std::to_string(Timestamp::Parse("31-12-2024 00:00:00")->ToTm().tm_yday), "365");
+
+	for (int64_t seconds : { (int64_t)0, (int64_t)-1, (int64_t)951782400, (int64_t)-2208988800, (int64_t)1792396800 }) {
+		Expect("FromTm(ToTm()) of " + std::to_string(seconds), std::to_string(Timestamp::FromTm(Timestamp(seconds).ToTm()).Seconds()), std::to_string(seconds));
+	}
+
+	std::tm overflow = {};
+	overflow.tm_year = 125;
+	overflow.tm_mon = 12;
+	overflow.tm_mday = 32;
+	Expect("FromTm normalises out-of-range fields", Timestamp::FromTm(overflow).Format(), "01-02-2026 00:00:00");
+
+	if (failures == 0) {
+		std::cout << "All timestamp checks passed\n";
+	}
+
+	return failures == 0 ? 0 : 1;
+}